@@ -0,0 +1,337 @@
+/// Copyright 2017-2019 Ghassan.pl
+/// Usage of the works is permitted provided that this instrument is retained with
+/// the works, so that any entity that uses the works is notified of this instrument.
+/// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "Cache.h"
+#include <mutex>
+#include <array>
+#include <cstring>
+
+/// Bump this whenever the layout of the cache file changes
+static constexpr uint32_t CacheFormatVersion = 6;
+static constexpr char CacheMagic[4] = { 'R', 'F', 'L', 'C' };
+
+std::map<std::string, CachedFile, std::less<>> PreviousFiles;
+std::map<std::string, CachedFile, std::less<>> CurrentFiles;
+std::mutex CurrentFilesMutex;
+
+namespace
+{
+	/// The cache never leaves the machine that made it, so native endianness is fine
+
+	struct BinaryWriter
+	{
+		std::string Data;
+
+		template <typename T>
+		void Write(T const& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			Data.append((const char*)&value, sizeof(T));
+		}
+
+		void Write(string_view str)
+		{
+			Write((uint32_t)str.size());
+			Data.append(str);
+		}
+
+		void Write(std::string const& str) { Write(string_view{ str }); }
+	};
+
+	struct BinaryReader
+	{
+		string_view Data;
+		/// Where the strings of the declarations read go, as they must outlive the data
+		StringArena* Strings = nullptr;
+
+		template <typename T>
+		T Read()
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			if (Data.size() < sizeof(T))
+				throw std::exception{ "Unexpected end of cache file" };
+			T result;
+			std::memcpy(&result, Data.data(), sizeof(T));
+			Data.remove_prefix(sizeof(T));
+			return result;
+		}
+
+		string_view ReadString()
+		{
+			const auto size = Read<uint32_t>();
+			if (Data.size() < size)
+				throw std::exception{ "Unexpected end of cache file" };
+			auto result = Data.substr(0, size);
+			Data.remove_prefix(size);
+			return result;
+		}
+
+		string_view ReadStoredString()
+		{
+			return Strings->Store(ReadString());
+		}
+	};
+
+	void WriteDeclaration(BinaryWriter& writer, Declaration const& decl)
+	{
+		const auto attributes = json::to_cbor(decl.Attributes);
+		writer.Write(string_view{ (const char*)attributes.data(), attributes.size() });
+		writer.Write(decl.Name);
+		writer.Write((uint64_t)decl.DeclarationLine);
+		writer.Write((uint8_t)decl.Access);
+		writer.Write((uint32_t)decl.Comments.size());
+		for (auto& comment : decl.Comments)
+			writer.Write(comment);
+	}
+
+	void ReadDeclaration(BinaryReader& reader, Declaration& decl)
+	{
+		const auto attributes = reader.ReadString();
+		decl.Attributes = json::from_cbor(attributes.begin(), attributes.end());
+		decl.Name = reader.ReadStoredString();
+		decl.DeclarationLine = (size_t)reader.Read<uint64_t>();
+		decl.Access = (AccessMode)reader.Read<uint8_t>();
+		decl.Comments.resize(reader.Read<uint32_t>());
+		for (auto& comment : decl.Comments)
+			comment = reader.ReadStoredString();
+	}
+
+	void WriteClass(BinaryWriter& writer, Class const& klass)
+	{
+		WriteDeclaration(writer, klass);
+		writer.Write(klass.Namespace);
+		writer.Write(klass.EnclosingClass);
+		writer.Write((uint8_t)klass.InTransparentNamespace);
+		writer.Write(klass.ParentClass);
+		writer.Write((uint64_t)klass.Flags.bits);
+		writer.Write((uint64_t)klass.BodyLine);
+
+		writer.Write((uint32_t)klass.Fields.size());
+		for (auto& field : klass.Fields)
+		{
+			WriteDeclaration(writer, field);
+			writer.Write((uint64_t)field.Flags.bits);
+			writer.Write(field.Type);
+			writer.Write(field.InitializingExpression);
+			writer.Write(field.DisplayName);
+		}
+
+		writer.Write((uint32_t)klass.Methods.size());
+		for (auto& method : klass.Methods)
+		{
+			WriteDeclaration(writer, method);
+			writer.Write((uint64_t)method.Flags.bits);
+			writer.Write(method.Type);
+			writer.Write(method.GetParameters());
+			writer.Write(method.Body);
+			writer.Write((uint64_t)method.SourceFieldDeclarationLine);
+			writer.Write(method.UniqueName);
+		}
+
+		writer.Write((uint32_t)klass.Properties.size());
+		for (auto& [key, property] : klass.Properties)
+		{
+			writer.Write(key);
+			writer.Write(property.Name);
+			writer.Write(property.SetterName);
+			writer.Write((uint64_t)property.SetterLine);
+			writer.Write(property.GetterName);
+			writer.Write((uint64_t)property.GetterLine);
+			writer.Write(property.Type);
+		}
+	}
+
+	void ReadClass(BinaryReader& reader, Class& klass)
+	{
+		ReadDeclaration(reader, klass);
+		/// Class names are interned, like when parsing
+		klass.Name = Intern(klass.Name);
+		klass.Namespace = Intern(reader.ReadString());
+		klass.EnclosingClass = Intern(reader.ReadString());
+		klass.InTransparentNamespace = reader.Read<uint8_t>() != 0;
+		klass.ParentClass = Intern(reader.ReadString());
+		klass.Flags.bits = (decltype(klass.Flags.bits))reader.Read<uint64_t>();
+		klass.BodyLine = (size_t)reader.Read<uint64_t>();
+
+		klass.Fields.resize(reader.Read<uint32_t>());
+		for (auto& field : klass.Fields)
+		{
+			ReadDeclaration(reader, field);
+			field.Flags.bits = (decltype(field.Flags.bits))reader.Read<uint64_t>();
+			field.Type = Intern(reader.ReadString());
+			field.InitializingExpression = reader.ReadStoredString();
+			field.DisplayName = reader.ReadStoredString();
+		}
+
+		klass.Methods.resize(reader.Read<uint32_t>());
+		for (auto& method : klass.Methods)
+		{
+			ReadDeclaration(reader, method);
+			method.Flags.bits = (decltype(method.Flags.bits))reader.Read<uint64_t>();
+			method.Type = Intern(reader.ReadString());
+			method.SetParameters(*reader.Strings, reader.ReadString());
+			method.Body = reader.ReadStoredString();
+			method.SourceFieldDeclarationLine = (size_t)reader.Read<uint64_t>();
+			method.UniqueName = reader.ReadStoredString();
+		}
+
+		const auto property_count = reader.Read<uint32_t>();
+		for (uint32_t i = 0; i < property_count; i++)
+		{
+			auto& property = klass.Properties[reader.ReadStoredString()];
+			property.Name = reader.ReadStoredString();
+			property.SetterName = reader.ReadStoredString();
+			property.SetterLine = (size_t)reader.Read<uint64_t>();
+			property.GetterName = reader.ReadStoredString();
+			property.GetterLine = (size_t)reader.Read<uint64_t>();
+			property.Type = Intern(reader.ReadString());
+		}
+	}
+
+	void WriteEnum(BinaryWriter& writer, Enum const& henum)
+	{
+		WriteDeclaration(writer, henum);
+		writer.Write(henum.Namespace);
+		writer.Write(henum.EnclosingClass);
+		writer.Write((uint32_t)henum.Enumerators.size());
+		for (auto& enumerator : henum.Enumerators)
+		{
+			WriteDeclaration(writer, enumerator);
+			writer.Write(enumerator.Value);
+		}
+	}
+
+	void ReadEnum(BinaryReader& reader, Enum& henum)
+	{
+		ReadDeclaration(reader, henum);
+		henum.Name = Intern(henum.Name);
+		henum.Namespace = Intern(reader.ReadString());
+		henum.EnclosingClass = Intern(reader.ReadString());
+		henum.Enumerators.resize(reader.Read<uint32_t>());
+		for (auto& enumerator : henum.Enumerators)
+		{
+			ReadDeclaration(reader, enumerator);
+			enumerator.Value = reader.Read<int64_t>();
+		}
+	}
+}
+
+std::string SerializeMirror(FileMirror const& mirror)
+{
+	BinaryWriter writer;
+	writer.Write(mirror.SourceFilePath.string());
+	writer.Write(mirror.SourceHash);
+	writer.Write((uint32_t)mirror.Classes.size());
+	for (auto& klass : mirror.Classes)
+		WriteClass(writer, klass);
+	writer.Write((uint32_t)mirror.Enums.size());
+	for (auto& henum : mirror.Enums)
+		WriteEnum(writer, henum);
+	return std::move(writer.Data);
+}
+
+FileMirror DeserializeMirror(string_view data)
+{
+	FileMirror mirror;
+	mirror.Strings = std::make_shared<StringArena>(data.size());
+	BinaryReader reader{ data, mirror.Strings.get() };
+	mirror.SourceFilePath = reader.ReadString();
+	mirror.SourceHash = reader.Read<uint64_t>();
+	mirror.Classes.resize(reader.Read<uint32_t>());
+	for (auto& klass : mirror.Classes)
+		ReadClass(reader, klass);
+	mirror.Enums.resize(reader.Read<uint32_t>());
+	for (auto& henum : mirror.Enums)
+		ReadEnum(reader, henum);
+	return mirror;
+}
+
+void LoadBuildCache(path const& cache_path, Options const& options)
+{
+	PreviousFiles.clear();
+
+	std::string contents;
+	if (options.Force || !ReadWholeFile(cache_path, contents))
+		return;
+
+	try
+	{
+		BinaryReader reader{ contents };
+		const auto magic = reader.Read<std::array<char, 4>>();
+		if (std::memcmp(magic.data(), CacheMagic, sizeof(CacheMagic)) != 0 || reader.Read<uint32_t>() != CacheFormatVersion)
+			return;
+		if (reader.Read<uint64_t>() != ToolHash || reader.Read<uint64_t>() != options.OutputOptionsHash)
+		{
+			if (options.Verbose)
+				PrintLine("Executable or options changed, ignoring build cache");
+			return;
+		}
+
+		const auto count = reader.Read<uint64_t>();
+		for (uint64_t i = 0; i < count; i++)
+		{
+			auto source_path = reader.ReadString();
+			CachedFile entry;
+			entry.SourceHash = reader.Read<uint64_t>();
+			entry.HasReflectionData = reader.Read<uint8_t>() != 0;
+			entry.MirrorKey = reader.Read<uint64_t>();
+			entry.Mirror = reader.ReadString();
+			PreviousFiles.emplace(source_path, entry);
+		}
+	}
+	catch (std::exception& e)
+	{
+		PrintLine("Warning: Build cache {} is corrupted ({}), ignoring", cache_path.string(), e.what());
+		PreviousFiles.clear();
+	}
+}
+
+void SaveBuildCache(path const& cache_path, Options const& options)
+{
+	BinaryWriter writer;
+	writer.Write(CacheMagic);
+	writer.Write(CacheFormatVersion);
+	writer.Write(ToolHash);
+	writer.Write(options.OutputOptionsHash);
+
+	std::unique_lock lock{ CurrentFilesMutex };
+	writer.Write((uint64_t)CurrentFiles.size());
+	for (auto& [source_path, entry] : CurrentFiles)
+	{
+		writer.Write(string_view{ source_path });
+		writer.Write(entry.SourceHash);
+		writer.Write((uint8_t)entry.HasReflectionData);
+		writer.Write(entry.MirrorKey);
+		writer.Write(entry.Mirror);
+	}
+
+	WriteFileIfChanged(cache_path, writer.Data);
+
+	PreviousFiles = CurrentFiles;
+}
+
+CachedFile const* FindCachedFile(path const& source_path)
+{
+	auto it = PreviousFiles.find(source_path.string());
+	return it != PreviousFiles.end() ? &it->second : nullptr;
+}
+
+void UpdateCachedFile(path const& source_path, CachedFile entry)
+{
+	std::unique_lock lock{ CurrentFilesMutex };
+	CurrentFiles[source_path.string()] = entry;
+}
+
+void UpdateCachedMirrorKey(path const& source_path, uint64_t mirror_key)
+{
+	std::unique_lock lock{ CurrentFilesMutex };
+	CurrentFiles[source_path.string()].MirrorKey = mirror_key;
+}
+
+void ForgetCachedFile(path const& source_path)
+{
+	std::unique_lock lock{ CurrentFilesMutex };
+	CurrentFiles.erase(source_path.string());
+}
@@ -0,0 +1,34 @@
+/// Copyright 2017-2019 Ghassan.pl
+/// Usage of the works is permitted provided that this instrument is retained with
+/// the works, so that any entity that uses the works is notified of this instrument.
+/// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#pragma once
+
+#include "Common.h"
+
+/// What we remember about a source file between runs
+struct CachedFile
+{
+	uint64_t SourceHash = 0;
+	bool HasReflectionData = false;
+	/// OutputKey of the mirror file we last generated from this file
+	uint64_t MirrorKey = 0;
+	/// The FileMirror as parsed (before any artificial methods were added), in SerializeMirror format
+	std::string Mirror;
+};
+
+/// Loads the cache left by the previous run; it is ignored if it was made by a different executable or different options
+void LoadBuildCache(path const& cache_path, Options const& options);
+/// Saves the state recorded during this run; it then also becomes what FindCachedFile compares against
+void SaveBuildCache(path const& cache_path, Options const& options);
+
+/// What the previous run knew about this file, if anything
+CachedFile const* FindCachedFile(path const& source_path);
+/// Records the state of this file for the next run (thread-safe)
+void UpdateCachedFile(path const& source_path, CachedFile entry);
+void UpdateCachedMirrorKey(path const& source_path, uint64_t mirror_key);
+void ForgetCachedFile(path const& source_path);
+
+std::string SerializeMirror(FileMirror const& mirror);
+FileMirror DeserializeMirror(string_view data);
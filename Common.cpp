@@ -5,14 +5,72 @@
 
 #include "Common.h"
 #include "Parse.h"
+#include "ThreadPool.h"
 #include <mutex>
 #include <future>
-#include <thread>
+#include <deque>
+#include <unordered_set>
+#include <unordered_map>
+#include <array>
 #include <fstream>
+#include <cstring>
 
-uint64_t ChangeTime = 0;
+uint64_t ToolHash = 0;
 std::vector<FileMirror> Mirrors;
 
+StringArena::StringArena(size_t expected_size)
+	: mResource(std::max<size_t>(expected_size, 256))
+{
+}
+
+string_view StringArena::Store(string_view str)
+{
+	if (str.empty())
+		return {};
+	auto data = static_cast<char*>(mResource.allocate(str.size(), 1));
+	std::memcpy(data, str.data(), str.size());
+	return { data, str.size() };
+}
+
+namespace
+{
+	/// The interned strings are split by hash, so threads interning different strings rarely wait for each other
+	struct InternShard
+	{
+		std::mutex Mutex;
+		std::unordered_set<string_view> Strings;
+		StringArena Storage{ 16 * 1024 };
+	};
+
+	std::array<InternShard, 16> InternShards;
+
+	InternShard& GetInternShard(string_view str)
+	{
+		return InternShards[std::hash<string_view>{}(str) % InternShards.size()];
+	}
+}
+
+string_view Intern(string_view str)
+{
+	if (str.empty())
+		return {};
+	auto& shard = GetInternShard(str);
+	std::unique_lock lock{ shard.Mutex };
+	if (auto it = shard.Strings.find(str); it != shard.Strings.end())
+		return *it;
+	return *shard.Strings.insert(shard.Storage.Store(str)).first;
+}
+
+string_view FindInterned(string_view str)
+{
+	if (str.empty())
+		return {};
+	auto& shard = GetInternShard(str);
+	std::unique_lock lock{ shard.Mutex };
+	auto it = shard.Strings.find(str);
+	return it != shard.Strings.end() ? *it : string_view{};
+}
+
 json Declaration::ToJSON() const
 {
 	json result = json::object();
@@ -27,13 +85,117 @@ json Declaration::ToJSON() const
 	return result;
 }
 
-Enum const* FindEnum(string_view name)
+namespace
 {
-	for (auto& mirror : Mirrors)
-		for (auto& henum : mirror.Enums)
-			if (henum.Name == name)
-				return &henum;
-	return nullptr;
+	/// The table is keyed by interned names, so looking a name up is finding its interned copy, then comparing addresses
+	template <typename T>
+	using SymbolMap = std::unordered_map<char const*, std::pair<T const*, FileMirror const*>>;
+
+	/// Every reflected class and enum, by qualified name, and by plain name; of repeated names, the first one (in mirror order) is kept
+	struct SymbolTable
+	{
+		SymbolMap<Class> Classes;
+		SymbolMap<Class> ClassesByName;
+		SymbolMap<Enum> Enums;
+		SymbolMap<Enum> EnumsByName;
+	};
+
+	SymbolTable Symbols;
+
+	/// The non-empty parts joined with `::`, interned
+	string_view ScopedName(string_view namespace_name, string_view enclosing_class, string_view name)
+	{
+		std::string result;
+		for (auto part : { namespace_name, enclosing_class, name })
+		{
+			if (!part.empty())
+				result += result.empty() ? std::string{ part } : fmt::format("::{}", part);
+		}
+		return Intern(result);
+	}
+
+	template <typename T>
+	std::pair<T const*, FileMirror const*> FindSymbol(SymbolMap<T> const& qualified, SymbolMap<T> const& by_name, string_view name, string_view from_scope)
+	{
+		auto find = [](SymbolMap<T> const& map, string_view key) -> std::pair<T const*, FileMirror const*> {
+			const auto interned = FindInterned(key);
+			if (interned.empty())
+				return {};
+			auto it = map.find(interned.data());
+			return it != map.end() ? it->second : std::pair<T const*, FileMirror const*>{};
+		};
+
+		if (name.starts_with("::"))
+			return find(qualified, name.substr(2));
+
+		while (true)
+		{
+			const auto candidate = from_scope.empty() ? std::string{ name } : fmt::format("{}::{}", from_scope, name);
+			if (auto result = find(qualified, candidate); result.first)
+				return result;
+			if (from_scope.empty())
+				break;
+			const auto enclosing = from_scope.rfind("::");
+			from_scope = enclosing == string_view::npos ? string_view{} : from_scope.substr(0, enclosing);
+		}
+
+		/// Names were matched without their namespaces before these were known, so keep finding those
+		return find(by_name, name);
+	}
+
+	template <typename T>
+	void AddSymbol(SymbolMap<T>& qualified, SymbolMap<T>& by_name, T const& declaration, FileMirror const& mirror, string_view kind)
+	{
+		const auto name = ScopedName(declaration.Namespace, declaration.EnclosingClass, declaration.Name);
+		if (auto [it, inserted] = qualified.try_emplace(name.data(), &declaration, &mirror); !inserted)
+		{
+			PrintLine("Warning: {}({},0): {} '{}' is also reflected in {}({},0); only that one will be found", mirror.SourceFilePath.string(), declaration.DeclarationLine + 1,
+				kind, name, it->second.second->SourceFilePath.string(), it->second.first->DeclarationLine + 1);
+		}
+		by_name.try_emplace(declaration.Name.data(), &declaration, &mirror);
+	}
+
+	void BuildSymbolTable()
+	{
+		Symbols = {};
+		for (auto& mirror : Mirrors)
+		{
+			for (auto& klass : mirror.Classes)
+				AddSymbol(Symbols.Classes, Symbols.ClassesByName, klass, mirror, "class");
+			for (auto& henum : mirror.Enums)
+				AddSymbol(Symbols.Enums, Symbols.EnumsByName, henum, mirror, "enum");
+		}
+	}
+}
+
+string_view QualifiedName(Class const& klass)
+{
+	return ScopedName(klass.Namespace, klass.EnclosingClass, klass.Name);
+}
+
+string_view QualifiedName(Enum const& henum)
+{
+	return ScopedName(henum.Namespace, henum.EnclosingClass, henum.Name);
+}
+
+std::pair<Class const*, FileMirror const*> FindClass(string_view name, string_view from_scope)
+{
+	return FindSymbol(Symbols.Classes, Symbols.ClassesByName, name, from_scope);
+}
+
+std::pair<Enum const*, FileMirror const*> FindEnum(string_view name, string_view from_scope)
+{
+	return FindSymbol(Symbols.Enums, Symbols.EnumsByName, name, from_scope);
+}
+
+std::pair<Class const*, FileMirror const*> FindParentClass(Class const& klass)
+{
+	/// Template arguments aren't part of what the table knows the class by
+	const auto parent = string_ops::trim_whitespace(klass.ParentClass.substr(0, klass.ParentClass.find('<')));
+	if (parent.empty())
+		return {};
+	/// Base classes are named from the scope around the class
+	return FindClass(parent, ScopedName(klass.Namespace, {}, klass.EnclosingClass));
 }
 
 void Field::CreateArtificialMethods(FileMirror& mirror, Class& klass)
@@ -48,7 +210,7 @@ void Field::CreateArtificialMethods(FileMirror& mirror, Class& klass)
 	/// Getters and Setters
 	if (!Flags.is_set(Reflector::FieldFlags::NoGetter))
 	{
-		klass.AddArtificialMethod(Type + " const &", "Get" + DisplayName, "", "return " + Name + ";", { "Gets " + field_comments }, { Reflector::MethodFlags::Const }, DeclarationLine);
+		klass.AddArtificialMethod(*mirror.ArtificialStrings, fmt::format("{} const &", Type), fmt::format("Get{}", DisplayName), "", fmt::format("return {};", Name), { "Gets " + field_comments }, { Reflector::MethodFlags::Const }, DeclarationLine);
 	}
 
 	if (!Flags.is_set(Reflector::FieldFlags::NoSetter))
@@ -56,7 +218,7 @@ void Field::CreateArtificialMethods(FileMirror& mirror, Class& klass)
 		auto on_change = Attributes.value("OnChange", "");
 		if (!on_change.empty())
 			on_change = on_change + "(); ";
-		klass.AddArtificialMethod("void", "Set" + DisplayName, Type + " const & value", Name + " = value; " + on_change, { "Sets " + field_comments }, {}, DeclarationLine);
+		klass.AddArtificialMethod(*mirror.ArtificialStrings, "void", fmt::format("Set{}", DisplayName), fmt::format("{} const & value", Type), fmt::format("{} = value; {}", Name, on_change), { "Sets " + field_comments }, {}, DeclarationLine);
 	}
 
 	auto flag_getters = Attributes.value("FlagGetters", "");
@@ -72,35 +234,37 @@ void Field::CreateArtificialMethods(FileMirror& mirror, Class& klass)
 
 	if (do_flags)
 	{
-		auto henum = FindEnum(string_view{ enum_name });
+		auto [henum, enum_mirror] = FindEnum(enum_name, QualifiedName(klass));
 		if (!henum)
 		{
 			ReportError(mirror.SourceFilePath, DeclarationLine, "Enum `{}' not reflected", enum_name);
 			return;
 		}
+		if (enum_mirror != &mirror)
+			mirror.Dependencies[enum_mirror->SourceFilePath] = enum_mirror->SourceHash;
 
 		for (auto& enumerator : henum->Enumerators)
 		{
-			klass.AddArtificialMethod("bool", "Is" + enumerator.Name, "", fmt::format("return ({} & {}{{{}}}) != 0;", Name, Type, 1ULL << enumerator.Value),
-				{ "Checks whether the `" + enumerator.Name + "` flag is set in " + field_comments }, Reflector::MethodFlags::Const, DeclarationLine);
+			klass.AddArtificialMethod(*mirror.ArtificialStrings, "bool", fmt::format("Is{}", enumerator.Name), "", fmt::format("return ({} & {}{{{}}}) != 0;", Name, Type, 1ULL << enumerator.Value),
+				{ fmt::format("Checks whether the `{}` flag is set in {}", enumerator.Name, field_comments) }, Reflector::MethodFlags::Const, DeclarationLine);
 		}
 
 		if (do_setters)
 		{
 			for (auto& enumerator : henum->Enumerators)
 			{
-				klass.AddArtificialMethod("void", "Set" + enumerator.Name, "", fmt::format("{} |= {}{{{}}};", Name, Type, 1ULL << enumerator.Value),
-					{ "Sets the `" + enumerator.Name + "` flag in " + field_comments }, {}, DeclarationLine);
+				klass.AddArtificialMethod(*mirror.ArtificialStrings, "void", fmt::format("Set{}", enumerator.Name), "", fmt::format("{} |= {}{{{}}};", Name, Type, 1ULL << enumerator.Value),
+					{ fmt::format("Sets the `{}` flag in {}", enumerator.Name, field_comments) }, {}, DeclarationLine);
 			}
 			for (auto& enumerator : henum->Enumerators)
 			{
-				klass.AddArtificialMethod("void", "Unset" + enumerator.Name, "", fmt::format("{} &= ~{}{{{}}};", Name, Type, 1ULL << enumerator.Value),
-					{ "Clears the `" + enumerator.Name + "` flag in " + field_comments }, {}, DeclarationLine);
+				klass.AddArtificialMethod(*mirror.ArtificialStrings, "void", fmt::format("Unset{}", enumerator.Name), "", fmt::format("{} &= ~{}{{{}}};", Name, Type, 1ULL << enumerator.Value),
+					{ fmt::format("Clears the `{}` flag in {}", enumerator.Name, field_comments) }, {}, DeclarationLine);
 			}
 			for (auto& enumerator : henum->Enumerators)
 			{
-				klass.AddArtificialMethod("void", "Toggle" + enumerator.Name, "", fmt::format("{} ^= {}{{{}}};", Name, Type, 1ULL << enumerator.Value),
-					{ "Toggles the `" + enumerator.Name + "` flag in " + field_comments }, {}, DeclarationLine);
+				klass.AddArtificialMethod(*mirror.ArtificialStrings, "void", fmt::format("Toggle{}", enumerator.Name), "", fmt::format("{} ^= {}{{{}}};", Name, Type, 1ULL << enumerator.Value),
+					{ fmt::format("Toggles the `{}` flag in {}", enumerator.Name, field_comments) }, {}, DeclarationLine);
 			}
 		}
 	}
@@ -122,36 +286,33 @@ json Field::ToJSON() const
 	return result;
 }
 
-void Method::Split()
+void Method::Split(StringArena& strings)
 {
-	auto args = SplitArgs(string_view{ mParameters });
-	std::vector<std::string> parameters_split;
-	std::transform(args.begin(), args.end(), std::back_inserter(parameters_split), [](string_view param) { return std::string{ param }; });
-
+	/// The parameters are already in the arena, so their parts can just point into them
 	ParametersSplit.clear();
-	for (auto& full_param : parameters_split)
+	for (auto full_param : SplitArgs(mParameters))
 	{
 		auto& param = ParametersSplit.emplace_back();
 		auto start_of_id = std::find_if(full_param.rbegin(), full_param.rend(), std::not_fn(string_ops::isident)).base();
-		param.Type = string_ops::trim_whitespace(string_ops::make_sv(full_param.begin(), start_of_id));
+		param.Type = Intern(string_ops::trim_whitespace(string_ops::make_sv(full_param.begin(), start_of_id)));
 		param.Name = string_ops::trim_whitespace(make_sv(start_of_id, full_param.end()));
 
 		if (param.Type.empty()) /// If we didn't specify a name, type was at the end, not name, so fix that
-			param.Type = param.Type + ' ' + param.Name;
+			param.Type = Intern(fmt::format(" {}", param.Name));
 	}
 
-	ParametersTypesOnly = string_ops::join(ParametersSplit, string_view{ "," }, [](MethodParameter const& param) { return param.Type; });
-	ParametersNamesOnly = string_ops::join(ParametersSplit, string_view{ "," }, [](MethodParameter const& param) { return param.Name; });
+	ParametersTypesOnly = strings.Store(string_ops::join(ParametersSplit, string_view{ "," }, [](MethodParameter const& param) { return param.Type; }));
+	ParametersNamesOnly = strings.Store(string_ops::join(ParametersSplit, string_view{ "," }, [](MethodParameter const& param) { return param.Name; }));
 }
 
-void Method::SetParameters(std::string params)
+void Method::SetParameters(StringArena& strings, string_view params)
 {
-	mParameters = std::move(params);
-	if (mParameters.find('=') != std::string::npos)
+	if (params.find('=') != string_view::npos)
 	{
 		throw std::exception{ "Default parameters not supported" };
 	}
-	Split();
+	mParameters = strings.Store(params);
+	Split(strings);
 }
 
 std::string Method::GetSignature(Class const& parent_class) const
@@ -172,9 +333,9 @@ void Method::CreateArtificialMethods(FileMirror& mirror, Class& klass)
 	if (klass.Flags.is_set(ClassFlags::HasProxy) && Flags.is_set(MethodFlags::Virtual))
 	{
 		if (Flags.is_set(MethodFlags::Abstract))
-			klass.AddArtificialMethod(Type, "_PROXY_"+Name, GetParameters(), fmt::format("throw std::runtime_error{{\"invalid abstract call to function {}::{}\"}};", klass.Name, Name), { "Proxy function for " + Name }, Flags - MethodFlags::Virtual, DeclarationLine);
+			klass.AddArtificialMethod(*mirror.ArtificialStrings, Type, fmt::format("_PROXY_{}", Name), GetParameters(), fmt::format("throw std::runtime_error{{\"invalid abstract call to function {}::{}\"}};", klass.Name, Name), { fmt::format("Proxy function for {}", Name) }, Flags - MethodFlags::Virtual, DeclarationLine);
 		else
-			klass.AddArtificialMethod(Type, "_PROXY_" + Name, GetParameters(), "return self_type::" + Name + "(" + ParametersNamesOnly + ");", { "Proxy function for " + Name }, Flags - MethodFlags::Virtual, DeclarationLine);
+			klass.AddArtificialMethod(*mirror.ArtificialStrings, Type, fmt::format("_PROXY_{}", Name), GetParameters(), fmt::format("return self_type::{}({});", Name, ParametersNamesOnly), { fmt::format("Proxy function for {}", Name) }, Flags - MethodFlags::Virtual, DeclarationLine);
 	}
 }
 
@@ -206,26 +367,30 @@ void Property::CreateArtificialMethods(FileMirror& mirror, Class& klass)
 {
 }
 
-void Class::AddArtificialMethod(std::string results, std::string name, std::string parameters, std::string body, std::vector<std::string> comments, enum_flags::enum_flags<Reflector::MethodFlags> additional_flags, size_t source_field_declaration_line)
+void Class::AddArtificialMethod(StringArena& strings, string_view results, string_view name, string_view parameters, string_view body, std::vector<std::string> const& comments, enum_flags::enum_flags<Reflector::MethodFlags> additional_flags, size_t source_field_declaration_line)
 {
 	Method method;
 	method.Flags += Reflector::MethodFlags::Artificial;
 	method.Flags += additional_flags;
-	method.Type = std::move(results);
-	method.Name = std::move(name);
-	method.SetParameters(std::move(parameters));
-	method.Body = std::move(body);
+	method.Type = Intern(results);
+	method.Name = strings.Store(name);
+	method.SetParameters(strings, parameters);
+	method.Body = strings.Store(body);
 	if (!method.Body.empty())
 		method.Flags += Reflector::MethodFlags::HasBody;
 	method.DeclarationLine = 0;
 	method.Access = AccessMode::Public;
-	method.Comments = std::move(comments);
+	for (auto& comment : comments)
+		method.Comments.push_back(strings.Store(comment));
 	method.SourceFieldDeclarationLine = source_field_declaration_line;
 	mArtificialMethods.push_back(std::move(method));
 }
 
 void Class::CreateArtificialMethods(FileMirror& mirror)
 {
+	/// Start from scratch, in case we've already been here (e.g. in watch mode)
+	std::erase_if(Methods, [](Method const& method) { return method.Flags.is_set(Reflector::MethodFlags::Artificial); });
+
 	/// Check if we should build proxy
 	bool should_build_proxy = false;
 
@@ -241,7 +406,7 @@ void Class::CreateArtificialMethods(FileMirror& mirror)
 
 	/// Create singleton method if singleton
 	if (Attributes.value("Singleton", false))
-		AddArtificialMethod("self_type&", "SingletonInstance", "", "static self_type instance; return instance;", { "Returns the single instance of this class" }, Reflector::MethodFlags::Static);
+		AddArtificialMethod(*mirror.ArtificialStrings, "self_type&", "SingletonInstance", "", "static self_type instance; return instance;", { "Returns the single instance of this class" }, Reflector::MethodFlags::Static);
 
 	/// Create methods for fields and methods
 
@@ -313,6 +478,10 @@ json Class::ToJSON() const
 	}
 
 	result["BodyLine"] = BodyLine;
+	if (!Namespace.empty())
+		result["Namespace"] = Namespace;
+	if (!EnclosingClass.empty())
+		result["EnclosingClass"] = EnclosingClass;
 
 	return result;
 }
@@ -327,6 +496,10 @@ json Enumerator::ToJSON() const
 json Enum::ToJSON() const
 {
 	json result = Declaration::ToJSON();
+	if (!Namespace.empty())
+		result["Namespace"] = Namespace;
+	if (!EnclosingClass.empty())
+		result["EnclosingClass"] = EnclosingClass;
 	auto& enumerators = result["Enumerators"] = json::object();
 	for (auto& enumerator : Enumerators)
 		enumerators[enumerator.Name] = enumerator.ToJSON();
@@ -348,6 +521,9 @@ json FileMirror::ToJSON() const
 
 void FileMirror::CreateArtificialMethods()
 {
+	/// The artificial methods made last time are all dropped below, before anything reads them
+	ArtificialStrings = std::make_shared<StringArena>();
+	Dependencies.clear();
 	for (auto& klass : Classes)
 	{
 		klass.CreateArtificialMethods(*this);
@@ -365,12 +541,19 @@ Options::Options(path const& options_file_path)
 
 	OPTION(Recursive, false, "Recursively search the provided directories for files");
 	OPTION(Quiet, false, "Don't print out created file names");
-	OPTION(Force, false, "Ignore timestamps, regenerate all files");
+	OPTION(Force, false, "Ignore the build cache, regenerate all files");
 	OPTION(Verbose, false, "Print additional information");
 	OPTION(CreateDatabase, true, "Create a JSON database with reflection data");
-	OPTION(UseJSON, true, "Output code that uses nlohmann::json to store class attributes");
+	OPTION(ShardDatabase, false, "Split the JSON database into one file per source directory (in the ReflectDatabase directory), listed in ReflectDatabase.index.json");
+	OPTION(CreateBinaryDatabase, false, "Also create the database in a binary form, for ReflectorDatabase.h to read without parsing");
+	OPTION(CreateRegistry, true, "Create a registry of all reflected types, for looking them up by name or type");
+	OPTION(CreateSerializers, false, "Output Serialize/Deserialize functions for a compact binary format in reflected classes; these add Serialize, Deserialize, StaticSkipSerialized and StaticSchemaHash members");
+	OPTION(UseJSON, true, "Output code that uses nlohmann::json (JSON conversion functions)");
 	OPTION(ForwardDeclare, true, "Output forward declarations of reflected classes");
+	OPTION(StaticReflectionData, false, "Output all reflection data as constexpr arrays instead of vectors, so it needs no allocations or static initialization.");
 	OPTION(CreateArtifacts, true, "Whether to generate artifacts (*.reflect.h files, db, others)");
+	OPTION(Jobs, 0, "Number of worker threads to use; 0 means one per hardware thread");
+	OPTION(ExcludeGlobs, std::vector<std::string>{}, "Paths to leave out when searching directories, as .gitignore-style patterns (`*`, `?`, `**`, a trailing `/` for directories only; no `!`)");
 	OPTION(AnnotationPrefix, "R", "The prefix for all annotation macros");
 	OPTION(MacroPrefix, "REFLECT", "The prefix for all autogenerated macros this tool will generate");
 
@@ -403,6 +586,9 @@ Options::Options(path const& options_file_path)
 	OPTION(MethodPrefix, AnnotationPrefix + "Method", "");
 	OPTION(BodyPrefix, AnnotationPrefix + "Body", "");
 
+	OutputOptionsHash = ContentHash(fmt::format("{}|{}|{}|{}|{}|{}|{}|{}|{}|{}|{}|{}|{}", UseJSON, ForwardDeclare, StaticReflectionData, CreateSerializers, AnnotationPrefix, MacroPrefix, MirrorExtension,
+		EnumPrefix, EnumeratorPrefix, ClassPrefix, FieldPrefix, MethodPrefix, BodyPrefix));
+
 	if (OptionsFile.size() > 0 && Verbose)
 	{
 		for (auto& opt : OptionsFile.items())
@@ -412,6 +598,290 @@ Options::Options(path const& options_file_path)
 	}
 }
 
+bool IsScannableFile(path const& file, Options const& options)
+{
+	auto u8file = file.string();
+	auto full = string_view{ u8file };
+	if (full.ends_with(options.MirrorExtension))
+		return false;
+
+	/// Same rules as path::extension(), but without making a lowercase copy of it
+	const auto name_start = full.find_last_of(std::filesystem::path::preferred_separator == '/' ? "/" : "/\\");
+	const auto name = full.substr(name_start == string_view::npos ? 0 : name_start + 1);
+	const auto dot = name.rfind('.');
+	if (dot == string_view::npos || dot == 0 || name == "..")
+		return false;
+	const auto ext = name.substr(dot);
+	return std::any_of(options.ExtensionsToScan.begin(), options.ExtensionsToScan.end(), [ext](string_view scanned) {
+		return std::equal(scanned.begin(), scanned.end(), ext.begin(), ext.end(), [](char a, char b) { return a == ::tolower((unsigned char)b); });
+	});
+}
+
+/// .gitignore-style matching: `*` and `?` don't match a '/', `**` does, and `**/` matches any number of whole directories
+static bool MatchesGlob(string_view pattern, string_view text)
+{
+	while (!pattern.empty())
+	{
+		if (pattern.starts_with("**"))
+		{
+			pattern.remove_prefix(2);
+			const bool whole_directories = pattern.starts_with('/');
+			if (whole_directories)
+				pattern.remove_prefix(1);
+			if (pattern.empty())
+				return true;
+			for (size_t i = 0; i <= text.size(); i++)
+			{
+				if ((!whole_directories || i == 0 || text[i - 1] == '/') && MatchesGlob(pattern, text.substr(i)))
+					return true;
+			}
+			return false;
+		}
+
+		if (pattern[0] == '*')
+		{
+			pattern.remove_prefix(1);
+			for (size_t i = 0; ; i++)
+			{
+				if (MatchesGlob(pattern, text.substr(i)))
+					return true;
+				if (i == text.size() || text[i] == '/')
+					return false;
+			}
+		}
+
+		if (text.empty() || (pattern[0] == '?' ? text[0] == '/' : pattern[0] != text[0]))
+			return false;
+		pattern.remove_prefix(1);
+		text.remove_prefix(1);
+	}
+	return text.empty();
+}
+
+bool MatchesExcludeGlobs(string_view relative_path, bool is_directory, Options const& options)
+{
+	const auto name = relative_path.substr(relative_path.rfind('/') + 1);
+	for (string_view pattern : options.ExcludeGlobs)
+	{
+		if (pattern.ends_with('/'))
+		{
+			if (!is_directory)
+				continue;
+			pattern.remove_suffix(1);
+		}
+
+		/// As in .gitignore, a pattern without a slash matches a name at any depth, and one with a slash the whole path
+		if (pattern.find('/') == string_view::npos)
+		{
+			if (MatchesGlob(pattern, name))
+				return true;
+		}
+		else
+		{
+			if (pattern.starts_with('/'))
+				pattern.remove_prefix(1);
+			if (MatchesGlob(pattern, relative_path))
+				return true;
+		}
+	}
+	return false;
+}
+
+bool IsExcludedPath(path const& file, bool is_directory, Options const& options)
+{
+	if (options.ExcludeGlobs.empty())
+		return false;
+
+	std::error_code ec;
+	for (auto& root : options.PathsToScan)
+	{
+		if (!std::filesystem::is_directory(root, ec))
+			continue;
+		const auto relative = std::filesystem::absolute(file).lexically_normal().lexically_relative(std::filesystem::canonical(root, ec)).generic_string();
+		if (ec || relative.empty() || relative == "." || relative.starts_with(".."))
+			continue;
+
+		for (auto slash = relative.find('/'); slash != std::string::npos; slash = relative.find('/', slash + 1))
+		{
+			if (MatchesExcludeGlobs(string_view{ relative }.substr(0, slash), true, options))
+				return true;
+		}
+		return MatchesExcludeGlobs(relative, is_directory, options);
+	}
+	return false;
+}
+
+void ScanDirectory(path const& directory, std::string const& relative_directory, Options const& options,
+	std::function<void(path)> const& on_file, std::function<void(path, std::string)> const& on_subdirectory)
+{
+	const bool check_excludes = !options.ExcludeGlobs.empty();
+	for (auto const& entry : std::filesystem::directory_iterator{ directory })
+	{
+		/// The entry already knows its type from the directory listing (d_type), so this needs no stat() per file
+		const bool is_directory = entry.is_directory();
+		if (is_directory && (!options.Recursive || entry.is_symlink()))
+			continue;
+
+		std::string relative_path;
+		if (check_excludes)
+		{
+			const auto name = entry.path().filename().generic_string();
+			relative_path = relative_directory.empty() ? name : relative_directory + '/' + name;
+			if (MatchesExcludeGlobs(relative_path, is_directory, options))
+				continue;
+		}
+
+		if (is_directory)
+			on_subdirectory(entry.path(), std::move(relative_path));
+		else if (IsScannableFile(entry.path(), options))
+			on_file(entry.path());
+	}
+}
+
+std::vector<path> FindFilesToScan(Options const& options)
+{
+	std::vector<path> final_files;
+	std::vector<std::pair<path, std::string>> directories;
+	for (auto& path : options.PathsToScan)
+	{
+		if (std::filesystem::is_directory(path))
+			directories.emplace_back(std::filesystem::canonical(path), std::string{});
+		else
+			final_files.push_back(path);
+	}
+
+	while (!directories.empty())
+	{
+		auto [directory, relative_directory] = std::move(directories.back());
+		directories.pop_back();
+		ScanDirectory(directory, relative_directory, options,
+			[&](path file) { final_files.push_back(std::move(file)); },
+			[&](path subdirectory, std::string relative_subdirectory) { directories.emplace_back(std::move(subdirectory), std::move(relative_subdirectory)); });
+	}
+	return final_files;
+}
+
+bool ReadWholeFile(path const& path, std::string& contents)
+{
+	std::ifstream infile{ path, std::ios::binary };
+	if (!infile)
+		return false;
+
+	infile.seekg(0, std::ios::end);
+	contents.resize((size_t)infile.tellg());
+	infile.seekg(0, std::ios::beg);
+	infile.read(contents.data(), contents.size());
+	return !infile.fail();
+}
+
+bool WriteFileIfChanged(path const& path, string_view contents)
+{
+	std::error_code ec;
+	if (std::filesystem::file_size(path, ec) == contents.size() && !ec)
+	{
+		std::string existing;
+		if (ReadWholeFile(path, existing) && existing == contents)
+			return false;
+	}
+
+	auto temp_path = path;
+	temp_path += ".tmp";
+	{
+		std::ofstream out{ temp_path, std::ios::binary | std::ios::trunc };
+		out.write(contents.data(), contents.size());
+		if (!out)
+			throw std::exception{ fmt::format("Could not write to {}", temp_path.string()).c_str() };
+	}
+	std::filesystem::rename(temp_path, path);
+	return true;
+}
+
+bool ReplaceFileIfChanged(path const& target_path, path const& temp_path)
+{
+	std::error_code ec;
+	if (std::filesystem::file_size(target_path, ec) == std::filesystem::file_size(temp_path) && !ec)
+	{
+		std::ifstream existing{ target_path, std::ios::binary }, replacement{ temp_path, std::ios::binary };
+		std::vector<char> existing_chunk(64 * 1024), replacement_chunk(64 * 1024);
+		bool same = existing && replacement;
+		while (same && replacement)
+		{
+			existing.read(existing_chunk.data(), existing_chunk.size());
+			replacement.read(replacement_chunk.data(), replacement_chunk.size());
+			same = existing.gcount() == replacement.gcount() && std::memcmp(existing_chunk.data(), replacement_chunk.data(), (size_t)replacement.gcount()) == 0;
+		}
+		if (same)
+		{
+			existing.close();
+			replacement.close();
+			std::filesystem::remove(temp_path);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temp_path, target_path);
+	return true;
+}
+
+namespace
+{
+	constexpr uint64_t Prime1 = 11400714785074694791ULL;
+	constexpr uint64_t Prime2 = 14029467366897019727ULL;
+	constexpr uint64_t Prime3 = 1609587929392839161ULL;
+	constexpr uint64_t Prime4 = 9650029242287828579ULL;
+	constexpr uint64_t Prime5 = 2870177450012600261ULL;
+
+	uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+	uint64_t Read64(const char* p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+	uint32_t Read32(const char* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+	uint64_t Round(uint64_t acc, uint64_t input) { return Rotl(acc + input * Prime2, 31) * Prime1; }
+	uint64_t MergeRound(uint64_t acc, uint64_t val) { return (acc ^ Round(0, val)) * Prime1 + Prime4; }
+}
+
+uint64_t ContentHash(string_view data, uint64_t seed)
+{
+	const char* p = data.data();
+	const char* const end = p + data.size();
+	uint64_t h = 0;
+
+	if (data.size() >= 32)
+	{
+		uint64_t v1 = seed + Prime1 + Prime2, v2 = seed + Prime2, v3 = seed, v4 = seed - Prime1;
+		for (; end - p >= 32; p += 32)
+		{
+			v1 = Round(v1, Read64(p));
+			v2 = Round(v2, Read64(p + 8));
+			v3 = Round(v3, Read64(p + 16));
+			v4 = Round(v4, Read64(p + 24));
+		}
+		h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+		h = MergeRound(h, v1);
+		h = MergeRound(h, v2);
+		h = MergeRound(h, v3);
+		h = MergeRound(h, v4);
+	}
+	else
+		h = seed + Prime5;
+
+	h += data.size();
+	for (; end - p >= 8; p += 8)
+		h = Rotl(h ^ Round(0, Read64(p)), 27) * Prime1 + Prime4;
+	if (end - p >= 4)
+	{
+		h = Rotl(h ^ (Read32(p) * Prime1), 23) * Prime2 + Prime3;
+		p += 4;
+	}
+	for (; p != end; p++)
+		h = Rotl(h ^ (uint8_t(*p) * Prime5), 11) * Prime1;
+
+	h ^= h >> 33;
+	h *= Prime2;
+	h ^= h >> 29;
+	h *= Prime3;
+	h ^= h >> 32;
+	return h;
+}
+
 void PrintSafe(std::ostream& strm, std::string val)
 {
 	static std::mutex print_mutex;
@@ -419,6 +889,28 @@ void PrintSafe(std::ostream& strm, std::string val)
 	strm << val;
 }
 
+namespace
+{
+	/// The mirrors one thread added since they were last collected. Only that thread adds to it, and collecting never happens at the same time,
+	/// so it needs no lock; a deque, so that growing it doesn't move the mirrors already in it.
+	using MirrorBuffer = std::deque<FileMirror>;
+
+	std::mutex MirrorBuffersMutex;
+	/// Shared with the threads, so a buffer outlives the thread that filled it
+	std::vector<std::shared_ptr<MirrorBuffer>> MirrorBuffers;
+
+	MirrorBuffer& ThreadMirrorBuffer()
+	{
+		thread_local const auto buffer = [] {
+			auto result = std::make_shared<MirrorBuffer>();
+			std::unique_lock lock{ MirrorBuffersMutex };
+			MirrorBuffers.push_back(result);
+			return result;
+		}();
+		return *buffer;
+	}
+}
+
 std::vector<FileMirror> const& GetMirrors()
 {
 	return Mirrors;
@@ -426,18 +918,44 @@ std::vector<FileMirror> const& GetMirrors()
 
 void AddMirror(FileMirror mirror)
 {
-	static std::mutex mirror_mutex;
-	std::unique_lock lock{ mirror_mutex };
-	Mirrors.push_back(std::move(mirror));
+	ThreadMirrorBuffer().push_back(std::move(mirror));
+}
+
+void RemoveMirror(path const& source_path)
+{
+	std::erase_if(Mirrors, [&](FileMirror const& mirror) { return mirror.SourceFilePath == source_path; });
+	/// It points into the mirrors, so it's no good until CollectMirrors rebuilds it
+	Symbols = {};
+}
+
+void CollectMirrors()
+{
+	{
+		std::unique_lock lock{ MirrorBuffersMutex };
+		size_t total = Mirrors.size();
+		for (auto& buffer : MirrorBuffers)
+			total += buffer->size();
+		Mirrors.reserve(total);
+		for (auto& buffer : MirrorBuffers)
+		{
+			std::move(buffer->begin(), buffer->end(), std::back_inserter(Mirrors));
+			buffer->clear();
+		}
+	}
+
+	std::sort(Mirrors.begin(), Mirrors.end(), [](FileMirror const& a, FileMirror const& b) { return a.SourceFilePath < b.SourceFilePath; });
+
+	BuildSymbolTable();
 }
 
-void CreateArtificialMethods()
+void CreateArtificialMethods(ThreadPool& pool)
 {
 	/// TODO: Not sure if these are safe to be multithreaded, we ARE adding new methods to the mirrors after all...
 	std::vector<std::future<void>> futures;
 	for (auto& mirror : Mirrors)
-		futures.push_back(std::async([&]() { mirror.CreateArtificialMethods(); }));
+		futures.push_back(pool.Submit([&]() { mirror.CreateArtificialMethods(); }));
 	
+	WaitForAll(futures);
 	for (auto& future : futures)
 		future.get(); /// to propagate exceptions
 }
@@ -9,6 +9,9 @@
 #include <filesystem>
 #include <string_view>
 #include <vector>
+#include <functional>
+#include <memory>
+#include <memory_resource>
 #include <nlohmann/json.hpp>
 #include "../enum_flags/include/enum_flags.h"
 #include "../string_ops/include/string_ops.h"
@@ -41,20 +44,57 @@ void PrintLine(ARGS&&... args)
 
 std::string EscapeJSON(json const& json);
 
+bool ReadWholeFile(path const& path, std::string& contents);
+/// Atomically replaces the file with `contents`, unless it already contains exactly that; returns whether it was written
+bool WriteFileIfChanged(path const& path, string_view contents);
+/// Same as WriteFileIfChanged, for contents that were streamed to `temp_path`; the temporary file is moved or removed
+bool ReplaceFileIfChanged(path const& target_path, path const& temp_path);
+
+/// XXH64 of the data (as long as we're running on a little-endian machine)
+uint64_t ContentHash(string_view data, uint64_t seed = 0);
+
 enum class AccessMode { Unspecified, Public, Private, Protected };
 
 static constexpr const char* AMStrings[] = { "Unspecified", "Public", "Private", "Protected" };
 
 struct FileMirror;
 struct Class;
+class ThreadPool;
+
+/// Holds the text of one file's declarations: strings are copied into a few big blocks, all freed at once with the arena,
+/// instead of every field of every declaration allocating its own
+class StringArena
+{
+public:
+
+	/// With a good guess of the total size, everything fits in one block
+	explicit StringArena(size_t expected_size = 0);
+
+	StringArena(StringArena const&) = delete;
+	StringArena& operator=(StringArena const&) = delete;
+
+	/// The returned view is valid for as long as the arena is
+	string_view Store(string_view str);
 
+private:
+
+	std::pmr::monotonic_buffer_resource mResource;
+};
+
+/// Strings that repeat a lot across files (type and class names, mostly) are kept just once, for the whole run.
+/// Equal interned strings are the same view, so they can be compared by address. Safe to call from any thread.
+string_view Intern(string_view str);
+/// The interned copy of the string, if it was ever interned; an empty view otherwise
+string_view FindInterned(string_view str);
+
+/// The strings of declarations point into the StringArena of their FileMirror, except for the names of types, which are interned
 struct Declaration
 {
 	json Attributes = json::object();
-	std::string Name;
+	string_view Name;
 	size_t DeclarationLine = 0;
 	AccessMode Access = AccessMode::Unspecified;
-	std::vector<std::string> Comments;
+	std::vector<string_view> Comments;
 
 	json ToJSON() const;
 };
@@ -62,9 +102,9 @@ struct Declaration
 struct Field : public Declaration
 {
 	enum_flags::enum_flags<Reflector::FieldFlags> Flags;
-	std::string Type;
-	std::string InitializingExpression;
-	std::string DisplayName;
+	string_view Type;
+	string_view InitializingExpression;
+	string_view DisplayName;
 
 	void CreateArtificialMethods(FileMirror& mirror, Class& klass);
 
@@ -90,8 +130,8 @@ struct Method : public Declaration
 {
 	struct MethodParameter
 	{
-		std::string Name;
-		std::string Type;
+		string_view Name;
+		string_view Type;
 		//std::string DefaultValue;
 		json ToJSON() const
 		{
@@ -100,20 +140,21 @@ struct Method : public Declaration
 		}
 	};
 
-	std::string Type;
+	string_view Type;
 	enum_flags::enum_flags<Reflector::MethodFlags> Flags;
 private:
-	std::string mParameters;
-	void Split();
+	string_view mParameters;
+	void Split(StringArena& strings);
 public:
-	void SetParameters(std::string params);
-	auto const& GetParameters() const { return mParameters; }
+	/// `params` is stored in `strings`, along with the parts it is split into
+	void SetParameters(StringArena& strings, string_view params);
+	string_view GetParameters() const { return mParameters; }
 	std::vector<MethodParameter> ParametersSplit;
-	std::string ParametersNamesOnly;
-	std::string ParametersTypesOnly;
-	std::string Body;
+	string_view ParametersNamesOnly;
+	string_view ParametersTypesOnly;
+	string_view Body;
 	size_t SourceFieldDeclarationLine = 0;
-	std::string UniqueName;
+	string_view UniqueName;
 
 	size_t ActualDeclarationLine() const
 	{
@@ -129,32 +170,39 @@ public:
 
 struct Property
 {
-	std::string Name;
-	std::string SetterName;
+	string_view Name;
+	string_view SetterName;
 	size_t SetterLine = 0;
-	std::string GetterName;
+	string_view GetterName;
 	size_t GetterLine = 0;
-	std::string Type;
+	string_view Type;
 
 	void CreateArtificialMethods(FileMirror& mirror, Class& klass);
 };
 
 struct Class : public Declaration
 {
-	std::string ParentClass;
+	/// The namespace the class is declared in, like `a::b`; empty for the global one
+	string_view Namespace;
+	/// The reflected classes it is nested in, like `Outer::Inner`; classes that aren't reflected aren't seen, so can't be here
+	string_view EnclosingClass;
+	/// Declared in an anonymous or inline namespace, which Namespace leaves out; so the class can't be declared again outside of it
+	bool InTransparentNamespace = false;
+	string_view ParentClass;
 
 	std::vector<Field> Fields;
 	std::vector<Method> Methods;
-	std::map<std::string, Property, std::less<>> Properties;
+	std::map<string_view, Property, std::less<>> Properties;
 
 	enum_flags::enum_flags<ClassFlags> Flags;
 
 	size_t BodyLine = 0;
 
-	void AddArtificialMethod(std::string results, std::string name, std::string parameters, std::string body, std::vector<std::string> comments, enum_flags::enum_flags<Reflector::MethodFlags> additional_flags = {}, size_t source_field_declaration_line = 0);
+	/// The strings are stored in `strings`, which must be the ArtificialStrings arena of the mirror this class is in
+	void AddArtificialMethod(StringArena& strings, string_view results, string_view name, string_view parameters, string_view body, std::vector<std::string> const& comments, enum_flags::enum_flags<Reflector::MethodFlags> additional_flags = {}, size_t source_field_declaration_line = 0);
 	void CreateArtificialMethods(FileMirror& mirror);
 
-	std::map<std::string, std::vector<Method const*>> MethodsByName;
+	std::map<string_view, std::vector<Method const*>> MethodsByName;
 
 	json ToJSON() const;
 
@@ -172,6 +220,10 @@ struct Enumerator : Declaration
 
 struct Enum : public Declaration
 {
+	/// The namespace the enum is declared in, like `a::b`; empty for the global one
+	string_view Namespace;
+	/// The reflected classes it is nested in, like `Outer::Inner`
+	string_view EnclosingClass;
 	std::vector<Enumerator> Enumerators;
 
 	json ToJSON() const;
@@ -180,18 +232,45 @@ struct Enum : public Declaration
 struct FileMirror
 {
 	path SourceFilePath;
+	uint64_t SourceHash = 0;
+	/// Where the strings of the declarations below are; shared, so moving or copying the mirror doesn't invalidate them
+	std::shared_ptr<StringArena> Strings = std::make_shared<StringArena>();
+	/// Where the strings of the artificial methods are; replaced whenever they are created anew, so watch mode doesn't keep every old set
+	std::shared_ptr<StringArena> ArtificialStrings = std::make_shared<StringArena>();
 	std::vector<Class> Classes;
 	std::vector<Enum> Enums;
 
+	/// Other files whose contents went into the artificial methods of this one (e.g. enums used as `Flags`), with their hashes
+	std::map<path, uint64_t> Dependencies;
+
 	json ToJSON() const;
 
 	void CreateArtificialMethods();
 };
 
-extern uint64_t ChangeTime;
+/// Hash of the reflector executable itself; if it changes, everything it generated before is suspect
+extern uint64_t ToolHash;
 std::vector<FileMirror> const& GetMirrors();
+/// Safe to call from many threads at once; the mirror only shows up in GetMirrors() after the next CollectMirrors()
 void AddMirror(FileMirror mirror);
-void CreateArtificialMethods();
+void RemoveMirror(path const& source_path);
+/// Merges in the mirrors added since the last call, and puts them all in a stable order (by path), so the artifacts come out the same every run.
+/// Also rebuilds the symbol table FindClass and FindEnum look in. Must not run at the same time as AddMirror.
+void CollectMirrors();
+
+/// The name of the class or enum with the namespace and classes it is in, like `a::b::Outer::Name`; with `::` in front, it names the type
+/// from anywhere. Interned.
+string_view QualifiedName(Class const& klass);
+string_view QualifiedName(Enum const& henum);
+
+/// Reflected classes and enums by `name`, as written in code in `from_scope`, a namespace or (qualified) class name: like C++, the name is
+/// looked for in that scope, then in each one around it, up to the global namespace. A name that matches nothing there is looked for
+/// without regard to scopes.
+std::pair<Class const*, FileMirror const*> FindClass(string_view name, string_view from_scope = {});
+std::pair<Enum const*, FileMirror const*> FindEnum(string_view name, string_view from_scope = {});
+/// The reflected class that `klass` derives from, if it derives from one
+std::pair<Class const*, FileMirror const*> FindParentClass(Class const& klass);
+void CreateArtificialMethods(ThreadPool& pool);
 
 struct Options
 {
@@ -205,9 +284,15 @@ struct Options
 	bool UseJSON = true;
 	bool CreateArtifacts = true;
 	bool CreateDatabase = true;
+	bool CreateBinaryDatabase = false;
+	bool ShardDatabase = false;
+	bool CreateRegistry = true;
+	bool CreateSerializers = false;
+	size_t Jobs = 0;
 
 	/// TODO: Read this from cmdline
 	bool ForwardDeclare = true;
+	bool StaticReflectionData = false;
 
 	path ArtifactPath;
 
@@ -218,6 +303,7 @@ struct Options
 
 	std::string MirrorExtension = ".mirror";
 	std::vector<std::string> ExtensionsToScan = { ".h", ".hpp", ".cpp" };
+	std::vector<std::string> ExcludeGlobs;
 
 	std::string EnumPrefix;
 	std::string EnumeratorPrefix;
@@ -228,8 +314,24 @@ struct Options
 
 	path OptionsFilePath;
 	json OptionsFile;
+
+	/// Hash of all the options that affect the generated code
+	uint64_t OutputOptionsHash = 0;
 };
 
+/// Whether this file has one of the extensions we scan (and is not one of our mirrors)
+bool IsScannableFile(path const& file, Options const& options);
+/// Whether a path inside one of the scanned directories, relative to it and with '/' separators, matches one of `options.ExcludeGlobs`.
+/// Only the path itself is checked, not the directories it is in.
+bool MatchesExcludeGlobs(string_view relative_path, bool is_directory, Options const& options);
+/// Whether the path is inside one of the scanned directories and is excluded, either itself or by a directory it's in
+bool IsExcludedPath(path const& file, bool is_directory, Options const& options);
+/// Lists the scannable files in `directory` to `on_file` and, when scanning recursively, the subdirectories to look in next to `on_subdirectory`;
+/// `relative_directory` is where `directory` is relative to the scanned directory it is in, and excluded paths are left out
+void ScanDirectory(path const& directory, std::string const& relative_directory, Options const& options,
+	std::function<void(path)> const& on_file, std::function<void(path, std::string)> const& on_subdirectory);
+std::vector<path> FindFilesToScan(Options const& options);
+
 inline std::string OnlyType(std::string str)
 {
 	auto last = str.find_last_of(':');
@@ -2,12 +2,131 @@
 
 #include <typeindex>
 #include <vector>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <span>
+#ifdef NLOHMANN_JSON_VERSION_MAJOR
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#endif
 
 namespace Reflector
 {
+#ifdef REFLECTOR_STATIC_DATA
+	/// In static data mode all reflection data is constexpr, and the lists point into arrays stored next to it
+	template <typename T>
+	using ReflectionList = std::span<T const>;
+	/// std::type_index can't be constexpr, so the type_info is referenced directly; it converts to a type_index and compares the same way
+	using TypeIndexRef = std::type_info const&;
+#else
+	/// These are vectors and not e.g. initializer_list's because you might want to create your own classes
+	template <typename T>
+	using ReflectionList = std::vector<T>;
+	using TypeIndexRef = std::type_index;
+#endif
+
 	struct ClassReflectionData;
 	struct FieldReflectionData;
 	struct MethodReflectionData;
+	struct PropertyReflectionData;
+
+	static constexpr size_t InvalidIndex = size_t(-1);
+
+	/// The hash Reflector uses to build the name tables it generates; changing it requires regenerating them
+	constexpr uint64_t NameHash(std::string_view name, uint64_t seed = 0) noexcept
+	{
+		uint64_t hash = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+		for (auto c : name)
+		{
+			hash ^= uint8_t(c);
+			hash *= 0x100000001b3ULL;
+		}
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	/// The only entry `name` can be at in a perfect hash table generated by Reflector (`key_count` entries in `displacements` and `slots`).
+	/// The caller still has to check that entry's name.
+	constexpr size_t NameTableCandidate(std::string_view name, size_t key_count, int32_t const* displacements, uint32_t const* slots) noexcept
+	{
+		if (key_count == 0)
+			return InvalidIndex;
+		const auto displacement = displacements[NameHash(name) % key_count];
+		const auto slot = displacement < 0 ? size_t(-(displacement + 1)) : size_t(NameHash(name, uint64_t(displacement)) % key_count);
+		return slots[slot];
+	}
+
+	/// Returns the index of the entry with that name in `names`, or InvalidIndex
+	constexpr size_t FindInNameTable(std::string_view name, size_t key_count, int32_t const* displacements, uint32_t const* slots, const char* const* names) noexcept
+	{
+		const auto index = NameTableCandidate(name, key_count, displacements, slots);
+		return index != InvalidIndex && names[index] == name ? index : InvalidIndex;
+	}
+
+	/// Binary search in a sorted array of values; returns the index of `value`, or InvalidIndex
+	template <size_t N>
+	constexpr size_t FindSortedValue(int64_t const (&values)[N], int64_t value) noexcept
+	{
+		size_t first = 0;
+		size_t count = N;
+		while (count > 0)
+		{
+			const auto half = count / 2;
+			if (values[first + half] < value)
+			{
+				first += half + 1;
+				count -= half + 1;
+			}
+			else
+				count = half;
+		}
+		return first < N && values[first] == value ? first : InvalidIndex;
+	}
+
+	/// A generated perfect hash of the names of some entries; empty for hand-made reflection data, in which case lookups fall back to a linear search
+	struct NameIndex
+	{
+		ReflectionList<int32_t> Displacements;
+		ReflectionList<uint32_t> Slots;
+
+		template <typename ENTRY>
+		ENTRY const* Find(std::string_view name, ReflectionList<ENTRY> const& entries, const char* ENTRY::* name_member) const noexcept
+		{
+			if (Slots.empty())
+			{
+				for (auto& entry : entries)
+					if (entry.*name_member == name)
+						return &entry;
+				return nullptr;
+			}
+			const auto index = NameTableCandidate(name, Slots.size(), Displacements.data(), Slots.data());
+			return index < entries.size() && entries[index].*name_member == name ? &entries[index] : nullptr;
+		}
+	};
+
+#ifdef NLOHMANN_JSON_VERSION_MAJOR
+	/// Parses an attributes string the first time it is asked for, and keeps the result for the rest of the program.
+	/// The cache is keyed by the address of the string, which is fine for the (immutable) reflection data.
+	inline nlohmann::json const& ParsedAttributes(const char* attributes)
+	{
+		static std::shared_mutex mutex;
+		static std::unordered_map<const char*, nlohmann::json> cache;
+		{
+			std::shared_lock lock{ mutex };
+			if (auto it = cache.find(attributes); it != cache.end())
+				return it->second;
+		}
+		auto parsed = attributes[0] ? nlohmann::json::parse(attributes) : nlohmann::json::object();
+		std::unique_lock lock{ mutex };
+		return cache.try_emplace(attributes, std::move(parsed)).first->second;
+	}
+#endif
 
 	struct ClassReflectionData
 	{
@@ -15,15 +134,27 @@ namespace Reflector
 		const char* ParentClassName = "";
 		const char* Attributes = "{}";
 #ifdef NLOHMANN_JSON_VERSION_MAJOR
-		nlohmann::json AttributesJSON;
+		nlohmann::json const& AttributesJSON() const { return ParsedAttributes(Attributes); }
 #endif
 		void* (*Constructor)(const ::Reflector::ClassReflectionData&) = {};
 
-		/// These are vectors and not e.g. initializer_list's because you might want to create your own classes
-		std::vector<FieldReflectionData> Fields; 
-		std::vector<MethodReflectionData> Methods;
+		ReflectionList<FieldReflectionData> Fields;
+		ReflectionList<MethodReflectionData> Methods;
+		ReflectionList<PropertyReflectionData> Properties;
+
+		NameIndex FieldIndex;
+		/// Overloaded methods are indexed by their first overload
+		NameIndex MethodIndex;
+		NameIndex MethodUniqueNameIndex;
+		NameIndex PropertyIndex;
 
-		std::type_index TypeIndex;
+		TypeIndexRef TypeIndex;
+
+		FieldReflectionData const* FindField(std::string_view name) const noexcept;
+		/// Returns the first method with this name; use FindMethodByUniqueName to tell overloads apart
+		MethodReflectionData const* FindMethod(std::string_view name) const noexcept;
+		MethodReflectionData const* FindMethodByUniqueName(std::string_view unique_name) const noexcept;
+		PropertyReflectionData const* FindProperty(std::string_view name) const noexcept;
 	};
 
 	enum class ClassFlags
@@ -109,9 +240,9 @@ namespace Reflector
 		const char* Initializer = "";
 		const char* Attributes = "{}";
 #ifdef NLOHMANN_JSON_VERSION_MAJOR
-		nlohmann::json AttributesJSON;
+		nlohmann::json const& AttributesJSON() const { return ParsedAttributes(Attributes); }
 #endif
-		std::type_index FieldTypeIndex;
+		TypeIndexRef FieldTypeIndex;
 
 		ClassReflectionData const* ParentClass = nullptr;
 	};
@@ -123,15 +254,28 @@ namespace Reflector
 		const char* Parameters = "";
 		const char* Attributes = "{}";
 #ifdef NLOHMANN_JSON_VERSION_MAJOR
-		nlohmann::json AttributesJSON;
+		nlohmann::json const& AttributesJSON() const { return ParsedAttributes(Attributes); }
 #endif
 		const char* UniqueName = "";
 		const char* Body = "";
-		std::type_index ReturnTypeIndex;
+		TypeIndexRef ReturnTypeIndex;
 
 		ClassReflectionData const* ParentClass = nullptr;
 	};
 
+	struct PropertyReflectionData
+	{
+		const char* Name = "";
+		const char* Type = "";
+		const char* GetterName = "";
+		const char* SetterName = "";
+	};
+
+	inline FieldReflectionData const* ClassReflectionData::FindField(std::string_view name) const noexcept { return FieldIndex.Find(name, Fields, &FieldReflectionData::Name); }
+	inline MethodReflectionData const* ClassReflectionData::FindMethod(std::string_view name) const noexcept { return MethodIndex.Find(name, Methods, &MethodReflectionData::Name); }
+	inline MethodReflectionData const* ClassReflectionData::FindMethodByUniqueName(std::string_view unique_name) const noexcept { return MethodUniqueNameIndex.Find(unique_name, Methods, &MethodReflectionData::UniqueName); }
+	inline PropertyReflectionData const* ClassReflectionData::FindProperty(std::string_view name) const noexcept { return PropertyIndex.Find(name, Properties, &PropertyReflectionData::Name); }
+
 	struct EnumeratorReflectionData
 	{
 		const char* Name = "";
@@ -142,10 +286,16 @@ namespace Reflector
 	{
 		const char* Name = "";
 		const char* Attributes = "{}";
-		std::vector<EnumeratorReflectionData> Enumerators;
-		std::type_index TypeIndex;
+#ifdef NLOHMANN_JSON_VERSION_MAJOR
+		nlohmann::json const& AttributesJSON() const { return ParsedAttributes(Attributes); }
+#endif
+		ReflectionList<EnumeratorReflectionData> Enumerators;
+		TypeIndexRef TypeIndex;
 	};
 
+	using ClassGetter = ClassReflectionData const& (*)();
+	using EnumGetter = EnumReflectionData const& (*)();
+
 	struct Reflectable
 	{
 		virtual ClassReflectionData const& GetReflectionData() const
@@ -154,9 +304,6 @@ namespace Reflector
 				.Name = "Reflectable",
 				.ParentClassName = "",
 				.Attributes = "",
-#ifdef NLOHMANN_JSON_VERSION_MAJOR
-				.AttributesJSON = ::nlohmann::json::object(),
-#endif
 				.TypeIndex = typeid(Reflectable)
 			}; 
 			return data;
@@ -172,6 +319,309 @@ namespace Reflector
 		ClassReflectionData const* mClass = nullptr;
 	};
 
+	/// ///////////////////////////////////// ///
+	/// Binary serialization
+	/// ///////////////////////////////////// ///
+
+	/// Types that hold addresses, which mean nothing once saved and loaded back, so can't be serialized
+	template <typename T>
+	inline constexpr bool IsPointerLikeImpl = std::is_pointer_v<T> || std::is_member_pointer_v<T>;
+	template <typename CHAR, typename TRAITS>
+	inline constexpr bool IsPointerLikeImpl<std::basic_string_view<CHAR, TRAITS>> = true;
+	template <typename T, size_t EXTENT>
+	inline constexpr bool IsPointerLikeImpl<std::span<T, EXTENT>> = true;
+	template <typename T>
+	inline constexpr bool IsPointerLike = IsPointerLikeImpl<std::remove_cv_t<T>>;
+
+	/// Writes the compact binary format used by the generated Serialize functions. Values are stored in native byte order,
+	/// containers as a count followed by the elements; anything with a Serialize(writer) function is written with that.
+	struct BinaryWriter
+	{
+		std::vector<char> Data;
+
+		void WriteBytes(void const* data, size_t size)
+		{
+			Data.insert(Data.end(), static_cast<char const*>(data), static_cast<char const*>(data) + size);
+		}
+
+		template <typename T>
+		void Write(T const& value)
+		{
+			static_assert(!IsPointerLike<T>, "pointers, string_views and spans can't be serialized, as the addresses they hold won't be valid when read back");
+			if constexpr (requires { value.Serialize(*this); })
+				value.Serialize(*this);
+			else if constexpr (std::is_trivially_copyable_v<T>)
+				WriteBytes(&value, sizeof(T));
+			else if constexpr (requires { value.first; value.second; })
+			{
+				Write(value.first);
+				Write(value.second);
+			}
+			else if constexpr (requires { value.data(); value.size(); typename T::value_type; requires std::is_trivially_copyable_v<typename T::value_type> && !IsPointerLike<typename T::value_type>; })
+			{
+				Write(uint64_t(value.size()));
+				WriteBytes(value.data(), value.size() * sizeof(typename T::value_type));
+			}
+			else
+			{
+				static_assert(requires { value.size(); value.begin(); value.end(); }, "type must be trivially copyable, a container, or have a Serialize function");
+				Write(uint64_t(value.size()));
+				for (auto const& element : value)
+					Write(element);
+			}
+		}
+	};
+
+	/// What BinaryReader reads the elements of a container into; maps have `pair<const K, V>` elements, which can't be read into
+	template <typename T>
+	struct ReadableElement { using type = typename T::value_type; };
+	template <typename T> requires requires { typename T::key_type; typename T::mapped_type; }
+	struct ReadableElement<T> { using type = std::pair<typename T::key_type, typename T::mapped_type>; };
+
+	/// Reads what BinaryWriter wrote. Running out of data doesn't throw; the values read are zeroed, and Failed is set.
+	struct BinaryReader
+	{
+		char const* Current = nullptr;
+		char const* End = nullptr;
+		bool Failed = false;
+
+		BinaryReader() noexcept = default;
+		BinaryReader(void const* data, size_t size) noexcept : Current(static_cast<char const*>(data)), End(Current + size) {}
+
+		void ReadBytes(void* data, size_t size)
+		{
+			if (Failed || size_t(End - Current) < size)
+			{
+				Failed = true;
+				std::memset(data, 0, size);
+				return;
+			}
+			std::memcpy(data, Current, size);
+			Current += size;
+		}
+
+		/// Moves past `size` bytes without reading them
+		void SkipBytes(size_t size)
+		{
+			if (Failed || size_t(End - Current) < size)
+			{
+				Failed = true;
+				return;
+			}
+			Current += size;
+		}
+
+		template <typename T>
+		void Read(T& value)
+		{
+			static_assert(!IsPointerLike<T>, "pointers, string_views and spans can't be serialized, as the addresses they hold won't be valid when read back");
+			if constexpr (requires { value.Deserialize(*this); })
+				value.Deserialize(*this);
+			else if constexpr (std::is_trivially_copyable_v<T>)
+				ReadBytes(&value, sizeof(T));
+			else if constexpr (requires { value.first; value.second; })
+			{
+				Read(value.first);
+				Read(value.second);
+			}
+			else
+			{
+				static_assert(requires { value.clear(); value.size(); }, "type must be trivially copyable, a container, or have a Deserialize function");
+				uint64_t count = 0;
+				Read(count);
+				value.clear();
+				if constexpr (requires { value.resize(count); value.data(); requires std::is_trivially_copyable_v<typename T::value_type> && !IsPointerLike<typename T::value_type>; })
+				{
+					if (Failed || count > size_t(End - Current) / sizeof(typename T::value_type))
+					{
+						Failed = true;
+						return;
+					}
+					value.resize(count);
+					ReadBytes(value.data(), count * sizeof(typename T::value_type));
+				}
+				else
+				{
+					for (uint64_t i = 0; i < count && !Failed; i++)
+					{
+						typename ReadableElement<T>::type element{};
+						Read(element);
+						value.insert(value.end(), std::move(element));
+					}
+				}
+			}
+		}
+
+		/// Moves past a value of type T that Read would have read, without making one
+		template <typename T>
+		void Skip()
+		{
+			using type = std::remove_cv_t<T>;
+			static_assert(!IsPointerLike<type>, "pointers, string_views and spans can't be serialized, as the addresses they hold won't be valid when read back");
+			if constexpr (requires { type::StaticSkipSerialized(*this); })
+				type::StaticSkipSerialized(*this);
+			else if constexpr (requires (type& value) { value.Deserialize(*this); })
+			{
+				static_assert(std::is_default_constructible_v<type>, "type with a Deserialize function needs a StaticSkipSerialized function to be skipped");
+				type ignored{};
+				ignored.Deserialize(*this);
+			}
+			else if constexpr (std::is_trivially_copyable_v<type>)
+				SkipBytes(sizeof(type));
+			else if constexpr (requires (type& value) { value.first; value.second; })
+			{
+				Skip<decltype(std::declval<type&>().first)>();
+				Skip<decltype(std::declval<type&>().second)>();
+			}
+			else
+			{
+				static_assert(requires { typename type::value_type; }, "type must be trivially copyable, a container, or have a Deserialize function");
+				uint64_t count = 0;
+				Read(count);
+				if constexpr (requires (type& value) { value.data(); requires std::is_trivially_copyable_v<typename type::value_type> && !IsPointerLike<typename type::value_type>; })
+				{
+					if (Failed || count > size_t(End - Current) / sizeof(typename type::value_type))
+					{
+						Failed = true;
+						return;
+					}
+					SkipBytes(count * sizeof(typename type::value_type));
+				}
+				else
+				{
+					for (uint64_t i = 0; i < count && !Failed; i++)
+						Skip<typename ReadableElement<type>::type>();
+				}
+			}
+		}
+	};
+
+	/// The schema hash of T (which includes those of its bases), or 0 if it doesn't have one
+	template <typename T>
+	constexpr uint64_t SchemaHashOf() noexcept
+	{
+		if constexpr (requires { T::StaticSchemaHash(); })
+			return T::StaticSchemaHash();
+		else
+			return 0;
+	}
+
+	constexpr uint64_t CombineSchemaHash(uint64_t hash, uint64_t parent_hash) noexcept
+	{
+		return hash ^ (parent_hash + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+	}
+
+	/// Used by the generated functions to (de)serialize the part of the object that belongs to its base class, if that has such functions
+	template <typename PARENT, typename T, typename WRITER>
+	void SerializeBase(T const& object, WRITER& writer)
+	{
+		if constexpr (requires { object.PARENT::Serialize(writer); })
+			object.PARENT::Serialize(writer);
+	}
+
+	template <typename PARENT, typename T, typename READER>
+	void DeserializeBase(T& object, READER& reader)
+	{
+		if constexpr (requires { object.PARENT::Deserialize(reader); })
+			object.PARENT::Deserialize(reader);
+	}
+
+	template <typename PARENT, typename READER>
+	void SkipBase(READER& reader)
+	{
+		if constexpr (requires { PARENT::StaticSkipSerialized(reader); })
+			PARENT::StaticSkipSerialized(reader);
+		else
+			static_assert(!requires (PARENT& object) { object.Deserialize(reader); }, "base class with a Deserialize function needs a StaticSkipSerialized function to be skipped");
+	}
+
+	/// Used by the generated functions for each saved field; fields that hold addresses are left out, whatever their type is spelled like
+	template <typename T, typename WRITER>
+	void SerializeField(T const& field, WRITER& writer)
+	{
+		if constexpr (!IsPointerLike<T>)
+			writer.Write(field);
+	}
+
+	template <typename T, typename READER>
+	void DeserializeField(T& field, READER& reader)
+	{
+		if constexpr (!IsPointerLike<T>)
+			reader.Read(field);
+	}
+
+	template <typename T, typename READER>
+	void SkipField(READER& reader)
+	{
+		if constexpr (!IsPointerLike<T>)
+			reader.template Skip<T>();
+	}
+
+	/// Writes the object preceded by its schema hash, so that DeserializeChecked can tell if the layout changed since
+	template <typename T, typename WRITER>
+	void SerializeChecked(WRITER& writer, T const& object)
+	{
+		writer.Write(T::StaticSchemaHash());
+		object.Serialize(writer);
+	}
+
+	/// Returns false (leaving the object untouched) if the data was written with a different schema
+	template <typename T, typename READER>
+	bool DeserializeChecked(READER& reader, T& object)
+	{
+		uint64_t schema_hash = 0;
+		reader.Read(schema_hash);
+		if (schema_hash != T::StaticSchemaHash())
+			return false;
+		object.Deserialize(reader);
+		return true;
+	}
+
+	/// ///////////////////////////////////// ///
+	/// JSON
+	/// ///////////////////////////////////// ///
+
+	/// Used by the generated to_json/from_json functions for the part of the object that belongs to its base class, if that has such functions
+	template <typename PARENT, typename JSON, typename T>
+	void ParentToJSON(JSON& j, T const& object)
+	{
+		if constexpr (requires { to_json(j, static_cast<PARENT const&>(object)); })
+			to_json(j, static_cast<PARENT const&>(object));
+		else
+			j = JSON::object();
+	}
+
+	template <typename PARENT, typename JSON, typename T>
+	void ParentFromJSON(JSON const& j, T& object)
+	{
+		if constexpr (requires { from_json(j, static_cast<PARENT&>(object)); })
+			from_json(j, static_cast<PARENT&>(object));
+	}
+
+	template <typename T>
+	inline constexpr bool IsCString = std::is_pointer_v<T> && std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, char>;
+
+	/// Used by the generated to_json/from_json functions for each field; like SerializeField, fields that hold addresses are left out by
+	/// their type. C strings are the exception when writing, as JSON has a place for them; they can't be read back into, though.
+	template <typename JSON, typename T>
+	void FieldToJSON(JSON& j, const char* name, T const& field)
+	{
+		if constexpr (IsCString<std::remove_cv_t<T>>)
+			j[name] = field ? JSON(field) : JSON(nullptr);
+		else if constexpr (!IsPointerLike<T>)
+			j[name] = field;
+	}
+
+	template <typename JSON, typename T>
+	void FieldFromJSON(JSON const& j, const char* name, T& field)
+	{
+		if constexpr (!IsPointerLike<T>)
+		{
+			if (auto it = j.find(name); it != j.end())
+				it->get_to(field);
+		}
+	}
+
 	template <typename T, typename PROXY_OBJ> 
 	struct ProxyFor
 	{
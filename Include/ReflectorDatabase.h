@@ -0,0 +1,367 @@
+/// Copyright 2017-2019 Ghassan.pl
+/// Usage of the works is permitted provided that this instrument is retained with
+/// the works, so that any entity that uses the works is notified of this instrument.
+/// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#pragma once
+
+#include "ReflectorClasses.h"
+#include <span>
+#include <utility>
+#ifndef REFLECTOR_DATABASE_FORMAT_ONLY
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#endif
+
+/// Reader for ReflectDatabase.bin, the binary form of ReflectDatabase.json (see the CreateBinaryDatabase option).
+/// The file is a header followed by arrays of fixed-size records, which reference each other by index and their strings
+/// by offset into a string table, so it can be used straight from memory without any parsing.
+/// The file is in the native byte order of the machine that created it.
+
+namespace Reflector::Database
+{
+	inline constexpr char Magic[4] = { 'R', 'F', 'D', 'B' };
+	/// Bump this whenever the layout of the records changes
+	inline constexpr uint32_t FormatVersion = 2;
+	/// An index that refers to no record
+	inline constexpr uint32_t NoRecord = ~0u;
+
+	/// A string in the string table; it is also null-terminated there
+	struct StringRef
+	{
+		uint32_t Offset = 0;
+		uint32_t Size = 0;
+	};
+
+	/// A range of records in one of the record arrays
+	struct RecordRange
+	{
+		uint32_t First = 0;
+		uint32_t Count = 0;
+	};
+
+	/// What every declaration has; Attributes are in JSON, Comments are joined with newlines
+	struct DeclarationRecord
+	{
+		StringRef Name;
+		StringRef Attributes;
+		StringRef Comments;
+		uint32_t DeclarationLine = 0;
+		uint32_t Access = 0; /// AccessMode: Unspecified, Public, Private, Protected
+	};
+
+	struct FileRecord
+	{
+		StringRef SourceFilePath;
+		RecordRange Classes;
+		RecordRange Enums;
+	};
+
+	struct ClassRecord
+	{
+		DeclarationRecord Declaration;
+		StringRef ParentClass;
+		uint32_t File = 0;
+		uint32_t Parent = NoRecord; /// The record of ParentClass, if it is reflected too
+		uint32_t Flags = 0; /// Bits of ClassFlags
+		uint32_t BodyLine = 0;
+		RecordRange Fields;
+		RecordRange Methods;
+	};
+
+	struct FieldRecord
+	{
+		DeclarationRecord Declaration;
+		StringRef Type;
+		StringRef InitializingExpression;
+		StringRef DisplayName;
+		uint32_t Flags = 0; /// Bits of FieldFlags
+	};
+
+	struct MethodRecord
+	{
+		DeclarationRecord Declaration;
+		StringRef ReturnType;
+		StringRef Parameters;
+		StringRef UniqueName;
+		StringRef Body;
+		uint32_t Flags = 0; /// Bits of MethodFlags
+		uint32_t SourceFieldDeclarationLine = 0; /// For artificial methods made for a field
+		RecordRange SplitParameters;
+	};
+
+	struct ParameterRecord
+	{
+		StringRef Name;
+		StringRef Type;
+	};
+
+	struct EnumRecord
+	{
+		DeclarationRecord Declaration;
+		uint32_t File = 0;
+		RecordRange Enumerators;
+	};
+
+	struct EnumeratorRecord
+	{
+		int64_t Value = 0;
+		DeclarationRecord Declaration;
+	};
+
+	/// A perfect hash of names, as built for NameTableCandidate; the slots hold record indices
+	struct NameTableRecord
+	{
+		uint32_t KeyCount = 0;
+		uint32_t Displacements = 0; /// Byte offset of KeyCount int32_t's
+		uint32_t Slots = 0; /// Byte offset of KeyCount uint32_t's
+	};
+
+	/// Each table is a byte offset (aligned to 8) and a count of records
+	struct Header
+	{
+		char Magic[4];
+		uint32_t Version;
+		uint32_t Size; /// Of the whole file
+		RecordRange Files;
+		RecordRange Classes;
+		RecordRange Fields;
+		RecordRange Methods;
+		RecordRange Parameters;
+		RecordRange Enums;
+		RecordRange Enumerators;
+		NameTableRecord ClassNames;
+		NameTableRecord EnumNames;
+		uint32_t Strings; /// Byte offset of the string table
+		uint32_t StringsSize;
+	};
+
+	/// The records are written as they are, so they must not have padding
+	static_assert(sizeof(DeclarationRecord) == 32 && sizeof(FileRecord) == 24 && sizeof(ClassRecord) == 72 && sizeof(FieldRecord) == 60);
+	static_assert(sizeof(MethodRecord) == 80 && sizeof(ParameterRecord) == 16 && sizeof(EnumRecord) == 44 && sizeof(EnumeratorRecord) == 40);
+	static_assert(sizeof(Header) == 100);
+
+	/// A view of a binary database somewhere in memory; all returned references point into that memory.
+	/// Nothing but Valid() may be called on an invalid (empty) view.
+	class DatabaseView
+	{
+	public:
+
+		DatabaseView() = default;
+
+		/// Checks that the data is a complete database of the current format; if it isn't, the view is left empty
+		DatabaseView(void const* data, size_t size) noexcept
+		{
+			if (size < sizeof(Header))
+				return;
+			auto header = static_cast<Header const*>(data);
+			if (std::memcmp(header->Magic, Magic, sizeof(Magic)) != 0 || header->Version != FormatVersion || header->Size != size)
+				return;
+
+			mData = static_cast<char const*>(data);
+			mHeader = header;
+			const bool valid =
+				ValidTable<FileRecord>(header->Files) && ValidTable<ClassRecord>(header->Classes) && ValidTable<FieldRecord>(header->Fields) &&
+				ValidTable<MethodRecord>(header->Methods) && ValidTable<ParameterRecord>(header->Parameters) && ValidTable<EnumRecord>(header->Enums) &&
+				ValidTable<EnumeratorRecord>(header->Enumerators) && ValidNameTable(header->ClassNames) && ValidNameTable(header->EnumNames) &&
+				uint64_t(header->Strings) + header->StringsSize <= size && (header->StringsSize == 0 || mData[uint64_t(header->Strings) + header->StringsSize - 1] == 0);
+			if (!valid)
+			{
+				mData = nullptr;
+				mHeader = nullptr;
+			}
+		}
+
+		bool Valid() const noexcept { return mHeader != nullptr; }
+		explicit operator bool() const noexcept { return Valid(); }
+
+		/// Offsets in the records are not checked up front; an out-of-range string comes back empty
+		std::string_view String(StringRef str) const noexcept
+		{
+			if (uint64_t(str.Offset) + str.Size >= mHeader->StringsSize)
+				return {};
+			return { mData + mHeader->Strings + str.Offset, str.Size };
+		}
+
+		std::span<FileRecord const> Files() const noexcept { return Table<FileRecord>(mHeader->Files); }
+		std::span<ClassRecord const> Classes() const noexcept { return Table<ClassRecord>(mHeader->Classes); }
+		std::span<EnumRecord const> Enums() const noexcept { return Table<EnumRecord>(mHeader->Enums); }
+
+		std::span<ClassRecord const> Classes(FileRecord const& file) const noexcept { return Sub<ClassRecord>(mHeader->Classes, file.Classes); }
+		std::span<EnumRecord const> Enums(FileRecord const& file) const noexcept { return Sub<EnumRecord>(mHeader->Enums, file.Enums); }
+		std::span<FieldRecord const> Fields(ClassRecord const& klass) const noexcept { return Sub<FieldRecord>(mHeader->Fields, klass.Fields); }
+		std::span<MethodRecord const> Methods(ClassRecord const& klass) const noexcept { return Sub<MethodRecord>(mHeader->Methods, klass.Methods); }
+		std::span<ParameterRecord const> Parameters(MethodRecord const& method) const noexcept { return Sub<ParameterRecord>(mHeader->Parameters, method.SplitParameters); }
+		std::span<EnumeratorRecord const> Enumerators(EnumRecord const& henum) const noexcept { return Sub<EnumeratorRecord>(mHeader->Enumerators, henum.Enumerators); }
+
+		FileRecord const* FileOf(ClassRecord const& klass) const noexcept { return At(Files(), klass.File); }
+		FileRecord const* FileOf(EnumRecord const& henum) const noexcept { return At(Files(), henum.File); }
+		/// Following this up gives the whole chain of reflected base classes
+		ClassRecord const* ParentOf(ClassRecord const& klass) const noexcept { return At(Classes(), klass.Parent); }
+
+		std::string_view Name(DeclarationRecord const& declaration) const noexcept { return String(declaration.Name); }
+		template <typename RECORD>
+		std::string_view Name(RECORD const& record) const noexcept { return String(record.Declaration.Name); }
+
+		/// If more than one class has the same name, only the first one can be found
+		ClassRecord const* FindClass(std::string_view name) const noexcept { return FindByName(name, mHeader->ClassNames, Classes()); }
+		EnumRecord const* FindEnum(std::string_view name) const noexcept { return FindByName(name, mHeader->EnumNames, Enums()); }
+
+		FieldRecord const* FindField(ClassRecord const& klass, std::string_view name) const noexcept { return FindLinear(name, Fields(klass)); }
+		/// The first overload with that name
+		MethodRecord const* FindMethod(ClassRecord const& klass, std::string_view name) const noexcept { return FindLinear(name, Methods(klass)); }
+		EnumeratorRecord const* FindEnumerator(EnumRecord const& henum, std::string_view name) const noexcept { return FindLinear(name, Enumerators(henum)); }
+
+	private:
+
+		char const* mData = nullptr;
+		Header const* mHeader = nullptr;
+
+		template <typename RECORD>
+		bool ValidTable(RecordRange table) const noexcept
+		{
+			return table.First % alignof(RECORD) == 0 && uint64_t(table.First) + uint64_t(table.Count) * sizeof(RECORD) <= mHeader->Size;
+		}
+
+		bool ValidNameTable(NameTableRecord const& table) const noexcept
+		{
+			return table.Displacements % alignof(int32_t) == 0 && table.Slots % alignof(uint32_t) == 0 &&
+				uint64_t(table.Displacements) + uint64_t(table.KeyCount) * sizeof(int32_t) <= mHeader->Size &&
+				uint64_t(table.Slots) + uint64_t(table.KeyCount) * sizeof(uint32_t) <= mHeader->Size;
+		}
+
+		template <typename RECORD>
+		std::span<RECORD const> Table(RecordRange table) const noexcept
+		{
+			return { reinterpret_cast<RECORD const*>(mData + table.First), table.Count };
+		}
+
+		template <typename RECORD>
+		std::span<RECORD const> Sub(RecordRange table, RecordRange range) const noexcept
+		{
+			if (uint64_t(range.First) + range.Count > table.Count)
+				return {};
+			return Table<RECORD>(table).subspan(range.First, range.Count);
+		}
+
+		template <typename RECORD>
+		static RECORD const* At(std::span<RECORD const> records, size_t index) noexcept
+		{
+			return index < records.size() ? &records[index] : nullptr;
+		}
+
+		template <typename RECORD>
+		RECORD const* FindByName(std::string_view name, NameTableRecord const& table, std::span<RECORD const> records) const noexcept
+		{
+			const auto index = NameTableCandidate(name, table.KeyCount, reinterpret_cast<int32_t const*>(mData + table.Displacements), reinterpret_cast<uint32_t const*>(mData + table.Slots));
+			auto record = At(records, index);
+			return record && Name(*record) == name ? record : nullptr;
+		}
+
+		template <typename RECORD>
+		RECORD const* FindLinear(std::string_view name, std::span<RECORD const> records) const noexcept
+		{
+			for (auto& record : records)
+				if (Name(record) == name)
+					return &record;
+			return nullptr;
+		}
+	};
+
+#ifndef REFLECTOR_DATABASE_FORMAT_ONLY
+	/// A database file mapped into memory (read-only) for as long as this object lives
+	class MappedDatabase : public DatabaseView
+	{
+	public:
+
+		MappedDatabase() = default;
+
+		/// Check Valid() afterwards; it's false if the file couldn't be mapped or isn't a database of the current format
+		explicit MappedDatabase(const char* path) noexcept
+		{
+#ifdef _WIN32
+			mFile = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (mFile == INVALID_HANDLE_VALUE)
+				return;
+			LARGE_INTEGER size{};
+			if (!::GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+				return;
+			mMapping = ::CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mMapping)
+				return;
+			mAddress = ::MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+			mSize = (size_t)size.QuadPart;
+#else
+			const int fd = ::open(path, O_RDONLY);
+			if (fd < 0)
+				return;
+			struct stat info {};
+			if (::fstat(fd, &info) == 0 && info.st_size > 0)
+			{
+				auto address = ::mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (address != MAP_FAILED)
+				{
+					mAddress = address;
+					mSize = (size_t)info.st_size;
+				}
+			}
+			::close(fd);
+#endif
+			if (mAddress)
+				static_cast<DatabaseView&>(*this) = DatabaseView{ mAddress, mSize };
+		}
+
+		MappedDatabase(MappedDatabase&& other) noexcept { Swap(other); }
+		MappedDatabase& operator=(MappedDatabase&& other) noexcept { MappedDatabase{ std::move(other) }.Swap(*this); return *this; }
+		MappedDatabase(MappedDatabase const&) = delete;
+		MappedDatabase& operator=(MappedDatabase const&) = delete;
+
+		~MappedDatabase()
+		{
+#ifdef _WIN32
+			if (mAddress)
+				::UnmapViewOfFile(mAddress);
+			if (mMapping)
+				::CloseHandle(mMapping);
+			if (mFile != INVALID_HANDLE_VALUE)
+				::CloseHandle(mFile);
+#else
+			if (mAddress)
+				::munmap(mAddress, mSize);
+#endif
+		}
+
+	private:
+
+		void* mAddress = nullptr;
+		size_t mSize = 0;
+#ifdef _WIN32
+		HANDLE mFile = INVALID_HANDLE_VALUE;
+		HANDLE mMapping = nullptr;
+#endif
+
+		void Swap(MappedDatabase& other) noexcept
+		{
+			std::swap(static_cast<DatabaseView&>(*this), static_cast<DatabaseView&>(other));
+			std::swap(mAddress, other.mAddress);
+			std::swap(mSize, other.mSize);
+#ifdef _WIN32
+			std::swap(mFile, other.mFile);
+			std::swap(mMapping, other.mMapping);
+#endif
+		}
+	};
+#endif
+}
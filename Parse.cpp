@@ -4,8 +4,14 @@
 /// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
 
 #include "Parse.h"
+#include "Cache.h"
 #include <charconv>
 #include <fstream>
+#include <cstring>
+#include <optional>
+#include <array>
+#include <atomic>
+#include <algorithm>
 
 std::string TypeFromVar(string_view str)
 {
@@ -133,6 +139,511 @@ std::tuple<std::string, std::string> ParseParameter(string_view& str)
 }
 */
 
+/// ///////////////////////////////////// ///
+/// Scanning
+/// ///////////////////////////////////// ///
+
+enum class TokenKind
+{
+	End,
+	Identifier,
+	/// Numbers, strings and characters
+	Literal,
+	Punctuation,
+	Comment,
+	/// A `///` comment that starts its line
+	DocComment,
+	PreprocessorDirective,
+	/// An empty (or whitespace-only) line
+	BlankLine,
+};
+
+struct Token
+{
+	TokenKind Kind = TokenKind::End;
+	string_view Text;
+	size_t Line = 0;
+};
+
+/// What follows an annotation, up to where it ends, with comments removed and line breaks turned into spaces
+struct DeclarationText
+{
+	std::string Text;
+	/// Where it starts
+	size_t Line = 0;
+};
+
+/// The scanner looks at every byte of every file, so it classifies them with tables
+static constexpr auto IdentifierChars = [] {
+	std::array<bool, 256> result{};
+	for (int c = 0; c < 256; c++)
+		result[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+	return result;
+}();
+
+static constexpr auto SpaceChars = [] {
+	std::array<bool, 256> result{};
+	for (int c : { ' ', '\t', '\r', '\v', '\f' })
+		result[c] = true;
+	return result;
+}();
+
+inline bool IsIdentifierChar(char c)
+{
+	return IdentifierChars[uint8_t(c)];
+}
+
+inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+bool IsEncodingPrefix(string_view str)
+{
+	return str.empty() || str == "L" || str == "u" || str == "U" || str == "u8";
+}
+
+/// Splits a source file into tokens in a single pass. Only what matters for finding annotations and the declarations after them
+/// is told apart; in particular comments, literals (including raw strings) and preprocessor directives are skipped over as a whole,
+/// so nothing in them is ever mistaken for an annotation.
+struct SourceScanner
+{
+	string_view Source;
+	size_t Position = 0;
+	/// 1-based
+	size_t Line = 1;
+	/// Whether anything but whitespace came before the current position on this line
+	bool LineHasContent = false;
+
+	explicit SourceScanner(string_view source) : Source(source) {}
+
+	bool AtEnd() const { return Position >= Source.size(); }
+	char Peek(size_t offset = 0) const { return Position + offset < Source.size() ? Source[Position + offset] : '\0'; }
+
+	Token Next()
+	{
+		const auto size = Source.size();
+		while (Position < size)
+		{
+			const char c = Source[Position];
+			if (SpaceChars[uint8_t(c)])
+			{
+				Position++;
+				continue;
+			}
+			if (c == '\n')
+			{
+				const bool blank = !LineHasContent;
+				Position++;
+				Line++;
+				LineHasContent = false;
+				if (blank)
+					return { TokenKind::BlankLine, {}, Line - 1 };
+				continue;
+			}
+
+			const bool starts_line = !LineHasContent;
+			LineHasContent = true;
+			const auto start = Position;
+			const auto line = Line;
+			auto token = [&](TokenKind kind) { return Token{ kind, string_view{ Source.data() + start, Position - start }, line }; };
+
+			if (c == '#' && starts_line)
+			{
+				SkipDirective();
+				return token(TokenKind::PreprocessorDirective);
+			}
+			if (c == '/' && Peek(1) == '/')
+			{
+				SkipTo(Source.find('\n', Position));
+				auto result = token(TokenKind::Comment);
+				if (starts_line && result.Text.starts_with("///"))
+					result.Kind = TokenKind::DocComment;
+				return result;
+			}
+			if (c == '/' && Peek(1) == '*')
+			{
+				const auto end = Source.find("*/", Position + 2);
+				SkipTo(end == string_view::npos ? end : end + 2);
+				return token(TokenKind::Comment);
+			}
+			if (c == '"' || c == '\'')
+			{
+				SkipQuoted();
+				return token(TokenKind::Literal);
+			}
+			if (IsDigit(c) || (c == '.' && IsDigit(Peek(1))))
+			{
+				SkipNumber();
+				return token(TokenKind::Literal);
+			}
+			if (IsIdentifierChar(c))
+			{
+				while (Position < size && IsIdentifierChar(Source[Position]))
+					Position++;
+				const auto identifier = string_view{ Source.data() + start, Position - start };
+				if (const auto next = Peek(); (next == '"' || next == '\'') && identifier.size() <= 3)
+				{
+					if (next == '"' && identifier.ends_with('R') && IsEncodingPrefix(identifier.substr(0, identifier.size() - 1)))
+					{
+						SkipRawString();
+						return token(TokenKind::Literal);
+					}
+					if (IsEncodingPrefix(identifier))
+					{
+						SkipQuoted();
+						return token(TokenKind::Literal);
+					}
+				}
+				return token(TokenKind::Identifier);
+			}
+
+			Position++;
+			return token(TokenKind::Punctuation);
+		}
+		return { TokenKind::End, {}, Line };
+	}
+
+	/// How SkipInsignificant sees each byte
+	enum SkipByte : uint8_t
+	{
+		/// Has to be looked at more closely: can start a comment, literal or directive, is a brace, or can start a significant identifier
+		SkipStop = 1,
+		SkipIdentifier = 2,
+		SkipSpace = 4,
+		SkipNewline = 8,
+	};
+	/// What SkipInsignificant stops at
+	struct SkipTable
+	{
+		std::array<uint8_t, 256> Bytes{};
+		/// The identifiers that matter
+		std::vector<string_view> Words;
+	};
+
+	static SkipTable MakeSkipTable(std::vector<string_view> significant_words)
+	{
+		SkipTable result;
+		for (int c = 0; c < 256; c++)
+		{
+			if (IdentifierChars[c])
+				result.Bytes[c] = SkipIdentifier;
+			else if (SpaceChars[c])
+				result.Bytes[c] = SkipSpace;
+		}
+		result.Bytes['\n'] = SkipNewline;
+		for (int c : { '/', '"', '\'', '#', '{', '}' })
+			result.Bytes[c] = SkipStop;
+		for (auto word : significant_words)
+		{
+			if (!word.empty())
+				result.Bytes[uint8_t(word[0])] |= SkipStop;
+		}
+		result.Words = std::move(significant_words);
+		return result;
+	}
+
+	/// Skips over what Next() would return as tokens that can't matter to the caller: everything but braces, comments, directives, literals,
+	/// and the significant words `table` was made with. This is most of a source file, so rather than being split into tokens, it is run through
+	/// with one table lookup per byte, in a loop that only branches off at bytes marked SkipStop (and not at those inside identifiers);
+	/// what Next() would have tracked along the way is worked out from the skipped text after.
+	/// Returns whether anything but whitespace was skipped; blank lines count, as Next() would have returned them.
+	bool SkipInsignificant(SkipTable const& table)
+	{
+		static_assert(SkipStop == 1 && SkipIdentifier == 2 && SkipNewline == 8, "the loop below relies on these bits");
+
+		/// Kept in locals, so the compiler doesn't have to assume writes through the source pointer change them
+		const auto data = Source.data();
+		const auto size = Source.size();
+		const auto start = Position;
+		auto position = Position;
+		auto line = Line;
+		/// Whether anything but whitespace is on the line before `at`
+		auto line_has_content = [&](size_t at) {
+			while (at > start && data[at - 1] != '\n')
+			{
+				if (!SpaceChars[uint8_t(data[--at])])
+					return true;
+			}
+			return at == start && LineHasContent;
+		};
+
+		uint8_t previous = 0;
+		for (; position < size; position++)
+		{
+			const char c = data[position];
+			uint8_t kind = table.Bytes[uint8_t(c)];
+			line += kind >> 3;
+			/// Only the start of an identifier can be significant
+			if ((kind & ~((kind & previous) >> 1)) & SkipStop)
+			{
+				if (kind & SkipIdentifier)
+				{
+					auto word_end = position + 1;
+					while (word_end < size && IsIdentifierChar(data[word_end]))
+						word_end++;
+					if (std::ranges::find(table.Words, string_view{ data + position, word_end - position }) != table.Words.end() && !InNumber(start, position))
+						break;
+					position = word_end - 1;
+					previous = SkipIdentifier;
+					continue;
+				}
+				const char next = position + 1 < size ? data[position + 1] : '\0';
+				if (c == '/' && (next == '/' || next == '*'))
+					break;
+				if (c == '#' && !line_has_content(position))
+					break;
+				if (c == '"' || c == '\'')
+				{
+					if (c == '\'' && IsIdentifierChar(next) && InNumber(start, position))
+						kind = SkipIdentifier; /// A digit separator, which doesn't end the number
+					else
+					{
+						/// The identifier before it may be the encoding prefix of the literal
+						auto word_start = position;
+						while (word_start > start && IsIdentifierChar(data[word_start - 1]))
+							word_start--;
+						if (word_start != position && position - word_start <= 3 && !IsDigit(data[word_start]) && !InNumber(start, word_start))
+							position = word_start;
+						break;
+					}
+				}
+				if (c == '{' || c == '}')
+					break;
+			}
+			previous = kind;
+		}
+
+		/// Usually the last line skipped has something on it, and then that's all that needs looking at
+		auto line_start = position;
+		bool last_line_has_content = false;
+		while (line_start > start && data[line_start - 1] != '\n')
+			last_line_has_content |= !SpaceChars[uint8_t(data[--line_start])];
+		const auto lines = line - Line;
+		const bool skipped = last_line_has_content || lines >= 2 || (lines == 1 && !LineHasContent) ||
+			std::any_of(data + start, data + line_start, [](char c) { return c != '\n' && !SpaceChars[uint8_t(c)]; });
+		LineHasContent = last_line_has_content || (line_start == start && LineHasContent);
+		Position = position;
+		Line = line;
+		return skipped;
+	}
+
+	/// Whether a number starting in [from, at) runs past `at`: numbers take in the identifiers, `.`s, exponent signs and digit separators
+	/// right after them. Only the text glued to `at` needs looking at, which is usually nothing.
+	bool InNumber(size_t from, size_t at) const
+	{
+		auto glued_start = at;
+		while (glued_start > from)
+		{
+			const char c = Source[glued_start - 1];
+			const bool exponent_sign = (c == '+' || c == '-') && glued_start - 1 > from && std::string_view{ "eEpP" }.find(Source[glued_start - 2]) != string_view::npos;
+			if (!IsIdentifierChar(c) && c != '.' && c != '\'' && !exponent_sign)
+				break;
+			glued_start--;
+		}
+
+		for (auto position = glued_start; position < at; )
+		{
+			if (IsDigit(Source[position]))
+			{
+				auto number = *this;
+				number.Position = position;
+				number.SkipNumber();
+				if (number.Position > at)
+					return true;
+				position = number.Position;
+			}
+			else if (IsIdentifierChar(Source[position]))
+			{
+				while (position < at && IsIdentifierChar(Source[position]))
+					position++;
+			}
+			else
+				position++;
+		}
+		return false;
+	}
+
+	/// The next token that isn't a comment, directive or blank line
+	Token NextCode()
+	{
+		while (true)
+		{
+			auto token = Next();
+			switch (token.Kind)
+			{
+			case TokenKind::Comment:
+			case TokenKind::DocComment:
+			case TokenKind::PreprocessorDirective:
+			case TokenKind::BlankLine:
+				continue;
+			default:
+				return token;
+			}
+		}
+	}
+
+	/// Whether the next code token is `str` (which is not consumed)
+	bool NextCodeIs(string_view str) const
+	{
+		auto lookahead = *this;
+		return lookahead.NextCode().Text == str;
+	}
+
+	/// Whether the next code token is a single `:` (and not part of a `::`)
+	bool NextCodeIsColon() const
+	{
+		auto lookahead = *this;
+		return lookahead.NextCode().Text == ":" && lookahead.Peek() != ':';
+	}
+
+	/// Reads up to the parenthesis matching the `(` token just read; returns the text including both parentheses
+	string_view ReadParenthesized(Token const& open)
+	{
+		for (int depth = 1; depth > 0; )
+		{
+			const auto token = NextCode();
+			if (token.Kind == TokenKind::End)
+				throw std::exception{ "Unexpected end of file in annotation" };
+			if (token.Kind != TokenKind::Punctuation)
+				continue;
+			if (token.Text == "(")
+				depth++;
+			else if (token.Text == ")")
+				depth--;
+		}
+		const auto start = size_t(open.Text.data() - Source.data());
+		return Source.substr(start, Position - start);
+	}
+
+	/// Reads a declaration up to the first of `terminators` outside of parentheses and brackets (and braces, if `braces_nest`).
+	/// If `include_terminator` is false, the terminator is neither part of the result, nor consumed.
+	DeclarationText ReadDeclaration(string_view terminators, bool include_terminator, bool braces_nest)
+	{
+		DeclarationText result;
+		size_t previous_end = string_view::npos;
+		int depth = 0;
+		while (true)
+		{
+			const auto before = *this;
+			const auto token = Next();
+			if (token.Kind == TokenKind::End)
+				throw std::exception{ "Unexpected end of file in declaration" };
+			if (token.Kind != TokenKind::Identifier && token.Kind != TokenKind::Literal && token.Kind != TokenKind::Punctuation)
+				continue;
+
+			const bool terminates = depth == 0 && token.Kind == TokenKind::Punctuation && terminators.find(token.Text[0]) != string_view::npos;
+			if (terminates && !include_terminator)
+			{
+				*this = before;
+				return result;
+			}
+
+			/// Whitespace within a line is kept as it is; anything with line breaks or comments in it becomes a single space
+			const auto start = size_t(token.Text.data() - Source.data());
+			if (previous_end == string_view::npos)
+				result.Line = token.Line;
+			else if (start != previous_end)
+			{
+				const auto gap = Source.substr(previous_end, start - previous_end);
+				if (gap.find_first_not_of(" \t") == string_view::npos)
+					result.Text += gap;
+				else
+					result.Text += ' ';
+			}
+			result.Text += token.Text;
+			previous_end = start + token.Text.size();
+
+			if (terminates)
+				return result;
+
+			if (token.Kind == TokenKind::Punctuation)
+			{
+				switch (token.Text[0])
+				{
+				case '(': case '[': depth++; break;
+				case ')': case ']': depth--; break;
+				case '{': if (braces_nest) depth++; break;
+				case '}': if (braces_nest) depth--; break;
+				}
+			}
+		}
+	}
+
+private:
+
+	/// Moves to `position` (or the end), counting the lines on the way
+	void SkipTo(size_t position)
+	{
+		position = std::min(position, Source.size());
+		Line += std::count(Source.begin() + Position, Source.begin() + position, '\n');
+		Position = position;
+	}
+
+	/// Up to the end of the line, or further if it ends with a backslash
+	void SkipDirective()
+	{
+		while (true)
+		{
+			const auto end = Source.find('\n', Position);
+			if (end == string_view::npos)
+				return SkipTo(end);
+			auto last = end;
+			if (last > Position && Source[last - 1] == '\r')
+				last--;
+			if (last == Position || Source[last - 1] != '\\')
+				return SkipTo(end);
+			SkipTo(end + 1);
+		}
+	}
+
+	/// A string or character literal; an unterminated one ends at the end of the line
+	void SkipQuoted()
+	{
+		const char quote = Source[Position++];
+		while (!AtEnd())
+		{
+			const auto special = Source.find_first_of(quote == '"' ? string_view{ "\"\\\n" } : string_view{ "'\\\n" }, Position);
+			if (special == string_view::npos || Source[special] == '\n')
+				return SkipTo(special);
+			if (Source[special] == quote)
+				return SkipTo(special + 1);
+			SkipTo(special + 2); /// escape sequence
+		}
+	}
+
+	void SkipRawString()
+	{
+		const auto open = Source.find('(', Position);
+		if (open == string_view::npos)
+			return SkipTo(open);
+		std::string closing = ")";
+		closing += Source.substr(Position + 1, open - Position - 1);
+		closing += '"';
+		const auto end = Source.find(closing, open + 1);
+		SkipTo(end == string_view::npos ? end : end + closing.size());
+	}
+
+	/// A preprocessing number, which also covers digit separators and exponents
+	void SkipNumber()
+	{
+		Position++;
+		while (!AtEnd())
+		{
+			const char c = Source[Position];
+			const char previous = Source[Position - 1];
+			if (IsIdentifierChar(c) || c == '.')
+				Position++;
+			else if (c == '\'' && IsIdentifierChar(Peek(1)))
+				Position++;
+			else if ((c == '+' || c == '-') && (previous == 'e' || previous == 'E' || previous == 'p' || previous == 'P'))
+				Position++;
+			else
+				break;
+		}
+	}
+};
+
 json ParseAttributeList(string_view line)
 {
 	line = string_ops::trim_whitespace(line);
@@ -144,65 +655,73 @@ json ParseAttributeList(string_view line)
 	return json::parse(line);
 }
 
-Enum ParseEnum(const std::vector<std::string>& lines, size_t& line_num, Options const& options)
+/// The doc comments point into the source, so they're copied to where the rest of the declaration's strings are
+std::vector<string_view> StoreComments(FileMirror const& mirror, std::vector<string_view> const& comments)
 {
-	Enum henum;
-
-	line_num--;
-	henum.DeclarationLine = line_num + 1;
+	std::vector<string_view> result;
+	result.reserve(comments.size());
+	for (auto comment : comments)
+		result.push_back(mirror.Strings->Store(comment));
+	return result;
+}
 
-	auto line = string_ops::trim_whitespace(string_view{ lines[line_num] });
-	line.remove_prefix(options.EnumPrefix.size());
-	henum.Attributes = ParseAttributeList(line);
+Enum ParseEnum(FileMirror const& mirror, SourceScanner scanner, string_view attributes, size_t line_num, std::vector<string_view> const& comments, Options const& options)
+{
+	Enum henum;
 
-	line_num++;
-	auto header_line = string_ops::trim_whitespace(string_view{ lines[line_num] });
+	henum.DeclarationLine = line_num;
+	henum.Attributes = ParseAttributeList(attributes);
 
-	header_line = Expect(header_line, "enum class");
+	const auto header = scanner.ReadDeclaration("{;", false, false);
+	auto header_line = Expect(header.Text, "enum class");
 	auto name_start = header_line.begin();
 	auto name_end = std::find_if_not(header_line.begin(), header_line.end(), string_ops::isident);
 
-	henum.Name = string_ops::trim_whitespace(string_ops::make_sv(name_start, name_end));
+	henum.Name = Intern(string_ops::trim_whitespace(string_ops::make_sv(name_start, name_end)));
+	henum.Comments = StoreComments(mirror, comments);
 	///TODO: parse base type
 
-	line_num++;
-	Expect(string_ops::trim_whitespace(string_view{ lines[line_num] }), "{");
+	if (scanner.NextCode().Text != "{")
+		throw std::exception{ "Expected `{`" };
 
-	line_num++;
 	int64_t enumerator_value = 0;
-	while (string_ops::trim_whitespace(string_view{ lines[line_num] }) != "};")
+	while (true)
 	{
-		auto enumerator_line = string_ops::trim_whitespace(string_view{ lines[line_num] });
-		if (enumerator_line.empty() || enumerator_line.starts_with("//") || enumerator_line.starts_with("/*") || enumerator_line.starts_with(options.EnumeratorPrefix))
+		const auto token = scanner.NextCode();
+		if (token.Kind == TokenKind::End)
+			throw std::exception{ "Expected `}`" };
+		if (token.Text == "}")
+			break;
+		if (token.Kind != TokenKind::Identifier)
+			continue;
+
+		if (token.Text == options.EnumeratorPrefix && scanner.NextCodeIs("("))
 		{
-			line_num++;
+			scanner.ReadParenthesized(scanner.NextCode());
 			continue;
 		}
 
-		auto name_start = enumerator_line.begin();
-		auto name_end = std::find_if_not(enumerator_line.begin(), enumerator_line.end(), string_ops::isident);
-
-		auto rest = string_ops::trim_whitespace(make_sv(name_end, enumerator_line.end()));
-		if (consume(rest, '='))
+		auto rest = scanner.ReadDeclaration(",}", false, true);
+		auto value = string_ops::trim_whitespace(string_view{ rest.Text });
+		if (consume(value, '='))
 		{
-			rest = string_ops::trim_whitespace(rest);
-			std::from_chars(std::to_address(rest.begin()), std::to_address(rest.end()), enumerator_value);
+			value = string_ops::trim_whitespace(value);
+			std::from_chars(std::to_address(value.begin()), std::to_address(value.end()), enumerator_value);
 			/// TODO: Non-integer enumerator values (like 1<<5 and constexpr function calls/expression)
 		}
 
-		auto name = make_sv(name_start, name_end);
-		if (!name.empty())
-		{
-			Enumerator enumerator;
-			enumerator.Name = string_ops::trim_whitespace(name);
-			enumerator.Value = enumerator_value;
-			enumerator.DeclarationLine = line_num;
-			/// TODO: enumerator.Attributes = {};
-			/// TODO: enumerator.Comments = "";
-			henum.Enumerators.push_back(std::move(enumerator));
-			enumerator_value++;
-		}
-		line_num++;
+		Enumerator enumerator;
+		enumerator.Name = mirror.Strings->Store(token.Text);
+		enumerator.Value = enumerator_value;
+		/// Enumerator lines have always been 0-based
+		enumerator.DeclarationLine = token.Line - 1;
+		/// TODO: enumerator.Attributes = {};
+		/// TODO: enumerator.Comments = "";
+		henum.Enumerators.push_back(std::move(enumerator));
+		enumerator_value++;
+
+		if (scanner.NextCodeIs(","))
+			scanner.NextCode();
 	}
 
 	return henum;
@@ -255,7 +774,7 @@ auto ParseClassDecl(string_view line)
 			string_ops::consume(line);
 		}
 
-		std::get<1>(result) = { std::to_address(start.begin()), std::to_address(line.begin()) };
+		std::get<1>(result) = string_ops::trim_whitespace(string_ops::make_sv(start.begin(), line.begin()));
 	}
 
 	return result;
@@ -269,17 +788,12 @@ std::tuple<std::string, std::string, std::string> ParseFieldDecl(string_view lin
 
 	SwallowOptional(line, "mutable");
 
-	string_view eq = "=", colon = ";";
+	/// The declaration ends at its `;`; there can be others before it, in braces in the initializer
 	string_view type_and_name = "";
-	auto eq_start = std::find_first_of(line.begin(), line.end(), eq.begin(), eq.end());
-	auto colon_start = std::find_first_of(line.begin(), line.end(), colon.begin(), colon.end());
-
-	if (!string_ops::trim_whitespace(string_ops::make_sv(colon_start + 1, line.end())).empty())
-	{
-		throw std::exception{ "Field must be only thing on line" };
-	}
+	auto colon_start = line.ends_with(';') ? line.end() - 1 : line.end();
+	auto eq_start = std::find(line.begin(), colon_start, '=');
 
-	if (eq_start != line.end())
+	if (eq_start != colon_start)
 	{
 		type_and_name = string_ops::trim_whitespace(string_ops::make_sv(line.begin(), eq_start));
 		std::get<2>(result) = string_ops::trim_whitespace(string_ops::make_sv(eq_start + 1, colon_start));
@@ -302,18 +816,19 @@ std::tuple<std::string, std::string, std::string> ParseFieldDecl(string_view lin
 	return result;
 }
 
-Field ParseFieldDecl(const FileMirror& mirror, Class& klass, string_view line, string_view next_line, size_t line_num, AccessMode mode, std::vector<std::string> comments, Options const& options)
+Field ParseFieldDecl(const FileMirror& mirror, Class& klass, string_view attributes, string_view declaration, size_t line_num, AccessMode mode, std::vector<string_view> const& comments)
 {
 	Field field;
-	line.remove_prefix(options.FieldPrefix.size());
 	field.Access = mode;
-	field.Attributes = ParseAttributeList(line);
+	field.Attributes = ParseAttributeList(attributes);
 	field.DeclarationLine = line_num;
-	field.Comments = std::move(comments);
-	auto decl = ParseFieldDecl(next_line);
-	std::tie(field.Type, field.Name, field.InitializingExpression) = decl;
+	field.Comments = StoreComments(mirror, comments);
+	const auto [type, name, initializing_expression] = ParseFieldDecl(declaration);
+	field.Type = Intern(type);
+	field.Name = mirror.Strings->Store(name);
+	field.InitializingExpression = mirror.Strings->Store(initializing_expression);
 	if (field.Name.size() > 1 && field.Name[0] == 'm' && isupper(field.Name[1]))
-		field.DisplayName.assign(field.Name.begin() + 1, field.Name.end());
+		field.DisplayName = field.Name.substr(1);
 	else
 		field.DisplayName = field.Name;
 
@@ -342,8 +857,7 @@ Field ParseFieldDecl(const FileMirror& mirror, Class& klass, string_view line, s
 		field.Flags.set(Reflector::FieldFlags::NoEdit, Reflector::FieldFlags::NoSetter);
 
 	/// ChildVector implies Setter = false
-	auto type = string_view{ field.Type };
-	if (type.starts_with("ChildVector<"))
+	if (field.Type.starts_with("ChildVector<"))
 		field.Flags.set(Reflector::FieldFlags::NoSetter);
 
 	/// Enable if explictly stated
@@ -391,15 +905,25 @@ std::vector<string_view> SplitArgs(string_view argstring)
 	return args;
 }
 
-Method ParseMethodDecl(Class& klass, string_view line, string_view next_line, size_t line_num, AccessMode mode, std::vector<std::string> comments, Options const& options)
+/// The property named by a GetterFor or SetterFor attribute
+Property& FindOrAddProperty(const FileMirror& mirror, Class& klass, json const& name)
+{
+	const auto& name_string = name.get_ref<std::string const&>();
+	auto property = klass.Properties.find(string_view{ name_string });
+	if (property == klass.Properties.end())
+	{
+		property = klass.Properties.emplace(mirror.Strings->Store(name_string), Property{}).first;
+		property->second.Name = property->first;
+	}
+	return property->second;
+}
+
+Method ParseMethodDecl(const FileMirror& mirror, Class& klass, string_view attributes, string_view next_line, size_t line_num, AccessMode mode, std::vector<string_view> const& comments)
 {
 	Method method;
-	line.remove_prefix(options.MethodPrefix.size());
 	method.Access = mode;
-	method.Attributes = ParseAttributeList(line);
+	method.Attributes = ParseAttributeList(attributes);
 	method.DeclarationLine = line_num;
-	
-	auto debug_copy = next_line;
 
 	while (true)
 	{
@@ -416,7 +940,7 @@ Method ParseMethodDecl(Class& klass, string_view line, string_view next_line, si
 
 	auto name_start = next_line.begin();
 	auto name_end = std::find_if_not(next_line.begin(), next_line.end(), string_ops::isident);
-	method.Name = string_ops::trim_whitespace(make_sv(name_start, name_end));
+	method.Name = mirror.Strings->Store(string_ops::trim_whitespace(make_sv(name_start, name_end)));
 	int num_pars = 0;
 	auto start_args = name_end;
 	next_line = make_sv(name_end, next_line.end());
@@ -428,7 +952,7 @@ Method ParseMethodDecl(Class& klass, string_view line, string_view next_line, si
 			num_pars--;
 		next_line.remove_prefix(1);
 	} while (num_pars);
-	method.SetParameters(std::string{ start_args + 1, next_line.begin() - 1 });
+	method.SetParameters(*mirror.Strings, make_sv(start_args + 1, next_line.begin() - 1));
 
 	next_line = string_ops::trim_whitespace(next_line);
 
@@ -453,11 +977,11 @@ Method ParseMethodDecl(Class& klass, string_view line, string_view next_line, si
 		}
 		if (next_line.ends_with("override"))
 			next_line.remove_suffix(sizeof("override") - 1);
-		method.Type = (std::string)string_ops::trim_whitespace(next_line);
+		method.Type = Intern(string_ops::trim_whitespace(next_line));
 	}
 	else
 	{
-		method.Type = pre_type;
+		method.Type = Intern(pre_type);
 
 		auto end_line = next_line.find_first_of("{;=");
 		if (end_line != std::string::npos && next_line[end_line] == '=')
@@ -465,23 +989,22 @@ Method ParseMethodDecl(Class& klass, string_view line, string_view next_line, si
 	}
 
 	if (auto getter = method.Attributes.find("UniqueName"); getter != method.Attributes.end())
-		method.UniqueName = getter->get<std::string>();
+		method.UniqueName = mirror.Strings->Store(getter->get_ref<std::string const&>());
 
 	if (auto getter = method.Attributes.find("GetterFor"); getter != method.Attributes.end())
 	{
-		auto& property = klass.Properties[getter.value()];
+		auto& property = FindOrAddProperty(mirror, klass, getter.value());
 		if (!property.GetterName.empty())
 			throw std::exception(fmt::format("Getter for this property already declared at line {}", property.GetterLine).c_str());
 		property.GetterName = method.Name;
 		property.GetterLine = line_num;
 		/// TODO: Match getter/setter types
 		property.Type = method.Type;
-		if (property.Name.empty()) property.Name = getter.value();
 	}
 
 	if (auto setter = method.Attributes.find("SetterFor"); setter != method.Attributes.end())
 	{
-		auto& property = klass.Properties[setter.value()];
+		auto& property = FindOrAddProperty(mirror, klass, setter.value());
 		if (!property.SetterName.empty())
 			throw std::exception(fmt::format("Setter for this property already declared at line {}", property.SetterLine).c_str());
 		property.SetterName = method.Name;
@@ -493,24 +1016,22 @@ Method ParseMethodDecl(Class& klass, string_view line, string_view next_line, si
 				throw std::exception("Setter must have at least 1 argument");
 			property.Type = method.ParametersSplit[0].Type;
 		}
-		if (property.Name.empty()) property.Name = setter.value();
 	}
 
-	method.Comments = std::move(comments);
+	method.Comments = StoreComments(mirror, comments);
 
 	return method;
 }
 
-Class ParseClassDecl(string_view line, string_view next_line, size_t line_num, std::vector<std::string> comments, Options const& options)
+Class ParseClassDecl(const FileMirror& mirror, string_view attributes, string_view declaration, size_t line_num, std::vector<string_view> const& comments)
 {
 	Class klass;
-	line.remove_prefix(options.ClassPrefix.size());
-	klass.Attributes = ParseAttributeList(line);
+	klass.Attributes = ParseAttributeList(attributes);
 	klass.DeclarationLine = line_num;
-	auto [name, parent, is_struct] = ParseClassDecl(next_line);
-	klass.Name = name;
-	klass.ParentClass = parent;
-	klass.Comments = std::move(comments);
+	auto [name, parent, is_struct] = ParseClassDecl(declaration);
+	klass.Name = Intern(name);
+	klass.ParentClass = Intern(parent);
+	klass.Comments = StoreComments(mirror, comments);
 	if (klass.ParentClass.empty())
 		klass.Flags += ClassFlags::Struct;
 	if (is_struct)
@@ -522,6 +1043,90 @@ Class ParseClassDecl(string_view line, string_view next_line, size_t line_num, s
 	return klass;
 }
 
+bool SourceFile::Load(path const& path)
+{
+	return ReadWholeFile(path, Contents);
+}
+
+struct NamespaceName
+{
+	std::string Name;
+	/// Anonymous, or inline in part; such namespaces are left out of Name, so it can't be used to open the namespace again
+	bool Transparent = false;
+};
+
+/// What follows `namespace`: the name of the namespace (empty for an anonymous one), if a body follows, so not for aliases and using-directives.
+/// Inline namespaces are left out of the name, as their members can be named without them.
+std::optional<NamespaceName> ReadNamespaceName(SourceScanner scanner, bool is_inline)
+{
+	NamespaceName result;
+	auto& name = result.Name;
+	for (auto token = scanner.NextCode(); token.Kind != TokenKind::End; token = scanner.NextCode())
+	{
+		if (token.Text == "{")
+		{
+			result.Transparent |= name.empty();
+			return result;
+		}
+		if (token.Kind == TokenKind::Identifier)
+		{
+			if (token.Text == "inline")
+				is_inline = true;
+			else if (std::exchange(is_inline, false))
+				result.Transparent = true;
+			else
+				name += name.empty() ? std::string{ token.Text } : fmt::format("::{}", token.Text);
+		}
+		else if (token.Text != ":")
+			break;
+	}
+	return std::nullopt;
+}
+
+enum class AnnotationKind { None, Enum, Class, Field, Method, Body };
+
+AnnotationKind GetAnnotationKind(string_view identifier, Options const& options)
+{
+	/// The annotation prefixes usually share their first letter, and few other identifiers have it
+	const auto first = identifier[0];
+	if (first != options.EnumPrefix[0] && first != options.ClassPrefix[0] && first != options.FieldPrefix[0] && first != options.MethodPrefix[0] && first != options.BodyPrefix[0])
+		return AnnotationKind::None;
+	if (identifier == options.EnumPrefix) return AnnotationKind::Enum;
+	if (identifier == options.ClassPrefix) return AnnotationKind::Class;
+	if (identifier == options.FieldPrefix) return AnnotationKind::Field;
+	if (identifier == options.MethodPrefix) return AnnotationKind::Method;
+	if (identifier == options.BodyPrefix) return AnnotationKind::Body;
+	return AnnotationKind::None;
+}
+
+static std::atomic<size_t> PrefilteredFileCount = 0;
+
+size_t GetPrefilteredFileCount()
+{
+	return PrefilteredFileCount;
+}
+
+/// Whether any annotation prefix appears anywhere in the contents, even in comments or strings.
+/// Most scanned files have none, and this lets them skip the parser: the search only stops at the first character of a prefix,
+/// which find() looks for with memchr, so it runs at vectorized memory speed.
+static bool MayContainAnnotations(string_view contents, Options const& options)
+{
+	const std::array<string_view, 5> prefixes = { options.EnumPrefix, options.ClassPrefix, options.FieldPrefix, options.MethodPrefix, options.BodyPrefix };
+
+	/// The prefixes usually share their first character; if they don't, look for each one separately
+	const auto first = prefixes[0][0];
+	if (std::any_of(prefixes.begin(), prefixes.end(), [first](string_view prefix) { return prefix[0] != first; }))
+		return std::any_of(prefixes.begin(), prefixes.end(), [contents](string_view prefix) { return contents.find(prefix) != string_view::npos; });
+
+	for (auto pos = contents.find(first); pos != string_view::npos; pos = contents.find(first, pos + 1))
+	{
+		const auto rest = contents.substr(pos);
+		if (std::any_of(prefixes.begin(), prefixes.end(), [rest](string_view prefix) { return rest.starts_with(prefix); }))
+			return true;
+	}
+	return false;
+}
+
 bool ParseClassFile(std::filesystem::path path, Options const& options)
 {
 	path = path.lexically_normal();
@@ -529,97 +1134,221 @@ bool ParseClassFile(std::filesystem::path path, Options const& options)
 	if (options.Verbose)
 		PrintLine("Analyzing file {}", path.string());
 
-	std::vector<std::string> lines;
-	std::string line;
-	std::ifstream infile{ path };
-	while (std::getline(infile, line))
-		lines.push_back(std::move(line));
-	infile.close();
+	SourceFile source;
+	if (!source.Load(path))
+	{
+		ReportError(path, 0, "Could not read file");
+		return false;
+	}
 
 	FileMirror mirror;
 	mirror.SourceFilePath = std::filesystem::absolute(path);
+	mirror.SourceHash = ContentHash(source.Contents);
+
+	if (!MayContainAnnotations(source.Contents, options))
+	{
+		PrefilteredFileCount++;
+		UpdateCachedFile(mirror.SourceFilePath, { mirror.SourceHash, false, 0, {} });
+		return true;
+	}
+
+	/// If the contents didn't change, neither did what we parsed out of them last time
+	if (auto cached = FindCachedFile(mirror.SourceFilePath); cached && cached->SourceHash == mirror.SourceHash)
+	{
+		try
+		{
+			if (cached->HasReflectionData)
+				AddMirror(DeserializeMirror(cached->Mirror));
+			UpdateCachedFile(mirror.SourceFilePath, *cached);
+			return true;
+		}
+		catch (std::exception&)
+		{
+			/// Corrupted cache entry, parse the file after all
+		}
+	}
+
+	/// The declarations are a part of the file's text, so with what the artificial methods add later, their strings rarely outgrow its size
+	mirror.Strings = std::make_shared<StringArena>(source.Contents.size());
 
 	AccessMode current_access = AccessMode::Unspecified;
 
-	std::vector<std::string> comments;
+	/// Doc comments on the lines right before an annotation belong to it
+	std::vector<string_view> comments;
 
-	for (size_t line_num = 1; line_num < lines.size(); line_num++)
+	/// The reflected classes whose bodies we're in, innermost last, with the brace depth of the body and the access mode around the class
+	struct OpenClass
+	{
+		size_t Index;
+		size_t Depth;
+		AccessMode OuterAccess;
+	};
+	std::vector<OpenClass> open_classes;
+	/// A class whose annotation we've seen, but whose body hasn't started yet
+	std::optional<OpenClass> pending_class;
+
+	/// The namespaces whose bodies we're in, with the brace depth of the body and the namespace around it
+	struct OpenNamespace
 	{
-		auto line = string_ops::trim_whitespace(string_view{ lines[line_num - 1] });
-		auto next_line = string_ops::trim_whitespace(string_view{ lines[line_num] });
+		size_t Depth;
+		std::string OuterName;
+		bool Transparent;
+	};
+	std::vector<OpenNamespace> open_namespaces;
+	/// The innermost namespace we're in, like `a::b`
+	std::string current_namespace;
+	/// A namespace whose body is about to start
+	std::optional<NamespaceName> pending_namespace;
+	size_t depth = 0;
+
+	/// The identifiers handled below: annotations, access specifiers and namespaces
+	const auto skip_table = SourceScanner::MakeSkipTable({ options.EnumPrefix, options.ClassPrefix, options.FieldPrefix, options.MethodPrefix, options.BodyPrefix, "public", "protected", "private", "namespace" });
+
+	SourceScanner scanner{ source.Contents };
+	while (true)
+	{
+		if (scanner.SkipInsignificant(skip_table))
+			comments.clear();
+
+		const auto token = scanner.Next();
+		if (token.Kind == TokenKind::End)
+			break;
 
+		if (token.Kind == TokenKind::DocComment)
+		{
+			comments.push_back(string_ops::trim_whitespace(token.Text.substr(3)));
+			continue;
+		}
+
+		size_t error_line = token.Line;
 		try
 		{
-			if (line.starts_with("public:"))
-				current_access = AccessMode::Public;
-			else if (line.starts_with("protected:"))
-				current_access = AccessMode::Protected;
-			else if (line.starts_with("private:"))
-				current_access = AccessMode::Private;
-			else if (line.starts_with(options.EnumPrefix))
+			if (token.Kind == TokenKind::Punctuation && token.Text == "{")
 			{
-				mirror.Enums.push_back(ParseEnum(lines, line_num, options));
-				mirror.Enums.back().Comments = std::move(comments);
-			}
-			else if (line.starts_with(options.ClassPrefix))
-			{
-				current_access = AccessMode::Private;
-				mirror.Classes.push_back(ParseClassDecl(line, next_line, line_num, std::move(comments), options));
-				if (options.Verbose)
+				depth++;
+				if (pending_class)
 				{
-					PrintLine("Found class {}", mirror.Classes.back().Name);
+					pending_class->Depth = depth;
+					open_classes.push_back(*pending_class);
+					pending_class.reset();
 				}
-			}
-			else if (line.starts_with(options.FieldPrefix))
-			{
-				if (mirror.Classes.size() == 0)
+				if (pending_namespace)
 				{
-					ReportError(path, line_num + 1, "{}() not in class", options.FieldPrefix);
-					return false;
+					open_namespaces.push_back({ depth, current_namespace, pending_namespace->Transparent });
+					if (!pending_namespace->Name.empty())
+						current_namespace = current_namespace.empty() ? std::move(pending_namespace->Name) : fmt::format("{}::{}", current_namespace, pending_namespace->Name);
+					pending_namespace.reset();
 				}
-
-				auto& klass = mirror.Classes.back();
-				klass.Fields.push_back(ParseFieldDecl(mirror, klass, line, next_line, line_num, current_access, std::move(comments), options));
 			}
-			else if (line.starts_with(options.MethodPrefix))
+			else if (token.Kind == TokenKind::Punctuation && token.Text == "}")
 			{
-				if (mirror.Classes.size() == 0)
+				if (!open_classes.empty() && open_classes.back().Depth == depth)
 				{
-					ReportError(path, line_num + 1, "{}() not in class", options.MethodPrefix);
-					return false;
+					current_access = open_classes.back().OuterAccess;
+					open_classes.pop_back();
 				}
-
-				auto& klass = mirror.Classes.back();
-				klass.Methods.push_back(ParseMethodDecl(klass, line, next_line, line_num, current_access, std::move(comments), options));
+				if (!open_namespaces.empty() && open_namespaces.back().Depth == depth)
+				{
+					current_namespace = std::move(open_namespaces.back().OuterName);
+					open_namespaces.pop_back();
+				}
+				if (depth > 0)
+					depth--;
 			}
-			else if (line.starts_with(options.BodyPrefix))
+			else if (token.Kind == TokenKind::Identifier)
 			{
-				if (mirror.Classes.size() == 0)
+				/// Access specifiers, but not e.g. the ones in base class lists
+				if ((token.Text == "public" || token.Text == "protected" || token.Text == "private") && scanner.NextCodeIsColon())
 				{
-					ReportError(path, line_num + 1, "{}() not in class", options.BodyPrefix);
-					return false;
+					current_access = token.Text == "public" ? AccessMode::Public : token.Text == "protected" ? AccessMode::Protected : AccessMode::Private;
+				}
+				else if (token.Text == "namespace")
+				{
+					auto before = string_view{ source.Contents }.substr(0, token.Text.data() - source.Contents.data());
+					before = before.substr(0, before.find_last_not_of(" \t\r\n") + 1);
+					pending_namespace = ReadNamespaceName(scanner, before.ends_with("inline"));
+				}
+				else if (const auto kind = GetAnnotationKind(token.Text, options); kind != AnnotationKind::None && scanner.NextCodeIs("("))
+				{
+					const auto line_num = token.Line;
+					const auto attributes = scanner.ReadParenthesized(scanner.NextCode());
+					auto declaration_scanner = scanner;
+
+					auto current_class = [&]() -> Class& {
+						if (open_classes.empty())
+							throw std::exception{ fmt::format("{}() not in class", token.Text).c_str() };
+						return mirror.Classes[open_classes.back().Index];
+					};
+					/// The reflected classes we're in, like `Outer::Inner`
+					auto enclosing_class = [&]() -> string_view {
+						if (open_classes.empty())
+							return {};
+						auto& outer = mirror.Classes[open_classes.back().Index];
+						return outer.EnclosingClass.empty() ? outer.Name : Intern(fmt::format("{}::{}", outer.EnclosingClass, outer.Name));
+					};
+
+					switch (kind)
+					{
+					case AnnotationKind::Enum:
+						mirror.Enums.push_back(ParseEnum(mirror, declaration_scanner, attributes, line_num, comments, options));
+						mirror.Enums.back().Namespace = Intern(current_namespace);
+						mirror.Enums.back().EnclosingClass = enclosing_class();
+						break;
+					case AnnotationKind::Class:
+					{
+						const auto declaration = declaration_scanner.ReadDeclaration("{;", false, false);
+						error_line = declaration.Line;
+						const auto outer_classes = enclosing_class();
+						pending_class = OpenClass{ mirror.Classes.size(), 0, current_access };
+						current_access = AccessMode::Private;
+						mirror.Classes.push_back(ParseClassDecl(mirror, attributes, declaration.Text, line_num, comments));
+						mirror.Classes.back().Namespace = Intern(current_namespace);
+						mirror.Classes.back().EnclosingClass = outer_classes;
+						mirror.Classes.back().InTransparentNamespace = std::ranges::any_of(open_namespaces, &OpenNamespace::Transparent);
+						if (options.Verbose)
+						{
+							PrintLine("Found class {}", mirror.Classes.back().Name);
+						}
+						break;
+					}
+					case AnnotationKind::Field:
+					{
+						auto& klass = current_class();
+						const auto declaration = declaration_scanner.ReadDeclaration(";", true, true);
+						error_line = declaration.Line;
+						klass.Fields.push_back(ParseFieldDecl(mirror, klass, attributes, declaration.Text, line_num, current_access, comments));
+						break;
+					}
+					case AnnotationKind::Method:
+					{
+						auto& klass = current_class();
+						const auto declaration = declaration_scanner.ReadDeclaration("{;", true, false);
+						error_line = declaration.Line;
+						klass.Methods.push_back(ParseMethodDecl(mirror, klass, attributes, declaration.Text, line_num, current_access, comments));
+						break;
+					}
+					case AnnotationKind::Body:
+						current_class().BodyLine = line_num;
+						current_access = AccessMode::Public;
+						break;
+					default:
+						break;
+					}
 				}
-
-				current_access = AccessMode::Public;
-
-				mirror.Classes.back().BodyLine = line_num;
 			}
 
-			if (line.starts_with("///"))
-			{
-				comments.push_back((std::string)string_ops::trim_whitespace(line.substr(3)));
-			}
-			else
-				comments.clear();
+			comments.clear();
 		}
 		catch (std::exception& e)
 		{
-			ReportError(path, line_num + 1, "{}", e.what());
+			ReportError(path, error_line, "{}", e.what());
 			return false;
 		}
 	}
 
-	if (mirror.Classes.size() > 0 || mirror.Enums.size() > 0)
+	const bool has_reflection_data = mirror.Classes.size() > 0 || mirror.Enums.size() > 0;
+	UpdateCachedFile(mirror.SourceFilePath, { mirror.SourceHash, has_reflection_data, 0, has_reflection_data ? SerializeMirror(mirror) : std::string{} });
+	if (has_reflection_data)
 		AddMirror(std::move(mirror));
 
 	return true;
@@ -7,7 +7,17 @@
 
 #include "Common.h"
 
+/// The contents of a source file, read in one go
+struct SourceFile
+{
+	std::string Contents;
+
+	bool Load(path const& path);
+};
+
 bool ParseClassFile(std::filesystem::path path, Options const& options);
+/// How many files ParseClassFile found no annotation prefixes in, and so skipped without parsing
+size_t GetPrefilteredFileCount();
 
 std::vector<string_view> SplitArgs(string_view argstring);
 
@@ -4,52 +4,358 @@
 /// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
 
 #include "ReflectionDataBuilding.h"
+#include "Cache.h"
+/// Only the format is needed here, not the file mapping (and its OS headers)
+#define REFLECTOR_DATABASE_FORMAT_ONLY
+#include "Include/ReflectorDatabase.h"
 #include <charconv>
+#include <numeric>
+#include <set>
+#include <functional>
+#include <fstream>
+#include <unordered_map>
+#include <limits>
+#include <cstring>
+
+uint64_t OutputKey(FileMirror const& file, const Options& opts)
+{
+	std::vector<uint64_t> parts = { file.SourceHash, ToolHash, opts.OutputOptionsHash };
+	for (auto& [dependency_path, dependency_hash] : file.Dependencies)
+	{
+		parts.push_back(ContentHash(dependency_path.string()));
+		parts.push_back(dependency_hash);
+	}
+	return ContentHash(string_view{ (const char*)parts.data(), parts.size() * sizeof(uint64_t) });
+}
+
+bool FileNeedsUpdating(const path& target_path, const path& source_path, uint64_t output_key, const Options& opts)
+{
+	if (opts.Force || !std::filesystem::exists(target_path))
+		return true;
+	auto cached = FindCachedFile(source_path);
+	return !cached || cached->MirrorKey != output_key;
+}
 
-uint64_t FileNeedsUpdating(const path& target_path, const path& source_path, const Options& opts)
+namespace
 {
-	auto stat = std::filesystem::status(target_path);
-	uint64_t file_change_time = std::max(ChangeTime, (uint64_t)std::filesystem::last_write_time(source_path).time_since_epoch().count());
-	if (stat.type() != std::filesystem::file_type::not_found)
+	/// Mirrors keyed by their path, in the order the keys of a json object are in (by string comparison, which is not the order CollectMirrors leaves them in)
+	using DatabaseEntries = std::vector<std::pair<std::string, FileMirror const*>>;
+
+	void SortDatabaseEntries(DatabaseEntries& entries)
+	{
+		std::sort(entries.begin(), entries.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+	}
+
+	/// The database is streamed out one mirror at a time, so only a single mirror's json is ever in memory;
+	/// the output is exactly what dumping the whole database object with dump(1, '\t') would give.
+	/// Returns whether the file changed.
+	bool WriteJSONDatabase(path const& path, DatabaseEntries const& entries)
 	{
-		/// Open file and get first line
-		std::ifstream f(target_path);
-		std::string line;
-		std::getline(f, line);
-		if (line.empty() || line.size() < sizeof(TIMESTAMP_TEXT))
-			return 1; /// corrupted file, regenerate
+		auto temp_path = path;
+		temp_path += ".tmp";
+		{
+			std::ofstream out{ temp_path, std::ios::binary | std::ios::trunc };
+			if (entries.empty())
+				out << "null";
+			else
+			{
+				string_view separator = "{\n\t";
+				for (auto& [key, mirror] : entries)
+				{
+					out << separator << json(key).dump() << ": ";
+					separator = ",\n\t";
+
+					/// Nested one level deeper; strings can't contain raw newlines, so every newline in the dump is structural
+					const auto value = mirror->ToJSON().dump(1, '\t');
+					size_t start = 0;
+					for (size_t newline; (newline = value.find('\n', start)) != std::string::npos; start = newline + 1)
+					{
+						out.write(value.data() + start, newline + 1 - start);
+						out.put('\t');
+					}
+					out.write(value.data() + start, value.size() - start);
+				}
+				out << "\n}";
+			}
+			if (!out)
+				throw std::exception{ fmt::format("Could not write to {}", temp_path.string()).c_str() };
+		}
 
-		uint64_t stored_change_time = 0;
-		const auto time = string_view{ string_view{ line }.substr(sizeof(TIMESTAMP_TEXT) - 1) };
-		const auto result = std::from_chars(std::to_address(time.begin()), std::to_address(time.end()), stored_change_time);
-		if (!opts.Force && result.ec == std::errc{} && file_change_time == stored_change_time)
-			return 0;
+		return ReplaceFileIfChanged(path, temp_path);
 	}
 
-	return file_change_time;
+	std::string ShardFileName(string_view directory)
+	{
+		return fmt::format("{:016x}.json", ContentHash(directory));
+	}
 }
 
 void CreateJSONDBArtifact(path const& path, Options const& options)
 {
-	json db;
+	DatabaseEntries entries;
+	for (auto& mirror : GetMirrors())
+		entries.emplace_back(mirror.SourceFilePath.string(), &mirror);
+	SortDatabaseEntries(entries);
+
+	const bool changed = WriteJSONDatabase(path, entries);
 
+	if (options.Verbose)
+		PrintLine(changed ? "Created {}" : "{} unchanged", path.string());
+}
+
+void CreateShardedJSONDBArtifact(path const& index_path, path const& shard_directory, Options const& options)
+{
+	std::map<std::string, DatabaseEntries> shards;
 	for (auto& mirror : GetMirrors())
+		shards[mirror.SourceFilePath.parent_path().string()].emplace_back(mirror.SourceFilePath.string(), &mirror);
+
+	/// The previous index tells us which shards are already up to date, and which ones are now gone
+	json previous_shards = json::object();
+	if (std::string contents; !options.Force && ReadWholeFile(index_path, contents))
 	{
-		db[mirror.SourceFilePath.string()] = mirror.ToJSON();
+		auto previous_index = json::parse(contents, nullptr, false);
+		if (previous_index.is_object() && previous_index["Shards"].is_object())
+			previous_shards = std::move(previous_index["Shards"]);
 	}
 
-	std::ofstream jsondb{ path, std::ios_base::openmode{ std::ios_base::trunc } };
-	jsondb << db.dump(1, '\t');
-	jsondb.close();
+	std::filesystem::create_directories(shard_directory);
+
+	json index = json::object();
+	auto& index_shards = index["Shards"] = json::object();
+	for (auto& [directory, entries] : shards)
+	{
+		SortDatabaseEntries(entries);
+
+		/// The output keys cover everything that goes into the mirrors' json
+		std::vector<uint64_t> keys;
+		json sources = json::array();
+		for (auto& [source_path, mirror] : entries)
+		{
+			keys.push_back(ContentHash(source_path));
+			keys.push_back(OutputKey(*mirror, options));
+			sources.push_back(source_path);
+		}
+		const auto shard_key = fmt::format("{:016x}", ContentHash(string_view{ (const char*)keys.data(), keys.size() * sizeof(uint64_t) }));
+		const auto shard_file = (shard_directory.filename() / ShardFileName(directory)).generic_string();
+
+		index_shards[directory] = { { "File", shard_file }, { "Key", shard_key }, { "Sources", std::move(sources) } };
+
+		const auto shard_path = shard_directory / ShardFileName(directory);
+		auto previous = previous_shards.find(directory);
+		if (previous != previous_shards.end() && previous->is_object() && previous->value("Key", "") == shard_key && std::filesystem::exists(shard_path))
+			continue;
+
+		const bool changed = WriteJSONDatabase(shard_path, entries);
+		if (options.Verbose)
+			PrintLine(changed ? "Created {}" : "{} unchanged", shard_path.string());
+	}
+
+	/// Directories that no longer have any reflected files
+	for (auto& [directory, shard] : previous_shards.items())
+	{
+		if (!index_shards.contains(directory))
+		{
+			std::error_code ec;
+			std::filesystem::remove(shard_directory / ShardFileName(directory), ec);
+		}
+	}
+
+	const bool changed = WriteFileIfChanged(index_path, index.dump(1, '\t'));
 
 	if (options.Verbose)
-		PrintLine("Created {}", path.string());
+		PrintLine(changed ? "Created {}" : "{} unchanged", index_path.string());
+}
+
+namespace
+{
+	using namespace Reflector::Database;
+
+	/// Collects the records and strings of the binary database
+	struct BinaryDatabaseBuilder
+	{
+		std::vector<FileRecord> Files;
+		std::vector<ClassRecord> Classes;
+		/// What each of Classes was made from, and the other way round, to find the records of parent classes once all are added
+		std::vector<::Class const*> ClassDeclarations;
+		std::unordered_map<::Class const*, uint32_t> ClassIndices;
+		std::vector<FieldRecord> Fields;
+		std::vector<MethodRecord> Methods;
+		std::vector<ParameterRecord> Parameters;
+		std::vector<EnumRecord> Enums;
+		std::vector<EnumeratorRecord> Enumerators;
+
+		std::string Strings;
+		std::unordered_map<std::string, StringRef> StringRefs;
+
+		/// Each distinct string is stored once
+		StringRef String(string_view str)
+		{
+			auto [it, inserted] = StringRefs.try_emplace(std::string{ str });
+			if (inserted)
+			{
+				it->second = { (uint32_t)Strings.size(), (uint32_t)str.size() };
+				Strings += str;
+				Strings += '\0';
+			}
+			return it->second;
+		}
+
+		DeclarationRecord Declaration(::Declaration const& declaration)
+		{
+			return {
+				.Name = String(declaration.Name),
+				.Attributes = String(declaration.Attributes.empty() ? std::string{} : declaration.Attributes.dump()),
+				.Comments = String(string_ops::join(declaration.Comments, string_view{ "\n" })),
+				.DeclarationLine = (uint32_t)declaration.DeclarationLine,
+				.Access = (uint32_t)declaration.Access,
+			};
+		}
+
+		void Add(FileMirror const& mirror)
+		{
+			const auto file_index = (uint32_t)Files.size();
+			auto& file = Files.emplace_back();
+			file.SourceFilePath = String(mirror.SourceFilePath.string());
+
+			file.Classes = { (uint32_t)Classes.size(), (uint32_t)mirror.Classes.size() };
+			for (auto& klass : mirror.Classes)
+			{
+				ClassRecord record{
+					.Declaration = Declaration(klass),
+					.ParentClass = String(klass.ParentClass),
+					.File = file_index,
+					.Flags = (uint32_t)klass.Flags.bits,
+					.BodyLine = (uint32_t)klass.BodyLine,
+					.Fields = { (uint32_t)Fields.size(), (uint32_t)klass.Fields.size() },
+					.Methods = { (uint32_t)Methods.size(), (uint32_t)klass.Methods.size() },
+				};
+				ClassIndices[&klass] = (uint32_t)Classes.size();
+				ClassDeclarations.push_back(&klass);
+				Classes.push_back(record);
+
+				for (auto& field : klass.Fields)
+				{
+					Fields.push_back({
+						.Declaration = Declaration(field),
+						.Type = String(field.Type),
+						.InitializingExpression = String(field.InitializingExpression),
+						.DisplayName = String(field.DisplayName),
+						.Flags = (uint32_t)field.Flags.bits,
+					});
+				}
+
+				for (auto& method : klass.Methods)
+				{
+					Methods.push_back({
+						.Declaration = Declaration(method),
+						.ReturnType = String(method.Type),
+						.Parameters = String(method.GetParameters()),
+						.UniqueName = String(method.UniqueName),
+						.Body = String(method.Body),
+						.Flags = (uint32_t)method.Flags.bits,
+						.SourceFieldDeclarationLine = (uint32_t)method.SourceFieldDeclarationLine,
+						.SplitParameters = { (uint32_t)Parameters.size(), (uint32_t)method.ParametersSplit.size() },
+					});
+					for (auto& parameter : method.ParametersSplit)
+						Parameters.push_back({ .Name = String(parameter.Name), .Type = String(parameter.Type) });
+				}
+			}
+
+			file.Enums = { (uint32_t)Enums.size(), (uint32_t)mirror.Enums.size() };
+			for (auto& henum : mirror.Enums)
+			{
+				Enums.push_back({
+					.Declaration = Declaration(henum),
+					.File = file_index,
+					.Enumerators = { (uint32_t)Enumerators.size(), (uint32_t)henum.Enumerators.size() },
+				});
+				for (auto& enumerator : henum.Enumerators)
+					Enumerators.push_back({ .Value = enumerator.Value, .Declaration = Declaration(enumerator) });
+			}
+		}
+
+		template <typename RECORD>
+		NameTableRecord NameTable(std::vector<RECORD> const& records, std::string& data)
+		{
+			std::vector<string_view> names;
+			for (auto& record : records)
+				names.push_back(string_view{ Strings }.substr(record.Declaration.Name.Offset, record.Declaration.Name.Size));
+			const auto table = BuildNameIndex(names);
+			return {
+				.KeyCount = (uint32_t)table.Slots.size(),
+				.Displacements = Append(data, table.Displacements),
+				.Slots = Append(data, table.Slots),
+			};
+		}
+
+		/// Appends the array to the data, aligned to 8 bytes; returns its offset
+		template <typename T>
+		static uint32_t Append(std::string& data, std::vector<T> const& values)
+		{
+			data.resize((data.size() + 7) & ~size_t(7), '\0');
+			const auto offset = (uint32_t)data.size();
+			data.append((const char*)values.data(), values.size() * sizeof(T));
+			return offset;
+		}
+
+		template <typename T>
+		static RecordRange Table(std::string& data, std::vector<T> const& records)
+		{
+			return { Append(data, records), (uint32_t)records.size() };
+		}
+
+		std::string Build()
+		{
+			for (size_t i = 0; i < Classes.size(); i++)
+			{
+				if (auto it = ClassIndices.find(FindParentClass(*ClassDeclarations[i]).first); it != ClassIndices.end())
+					Classes[i].Parent = it->second;
+			}
+
+			std::string data(sizeof(Header), '\0');
+			Header header{};
+			std::memcpy(header.Magic, Magic, sizeof(Magic));
+			header.Version = FormatVersion;
+			header.Files = Table(data, Files);
+			header.Classes = Table(data, Classes);
+			header.Fields = Table(data, Fields);
+			header.Methods = Table(data, Methods);
+			header.Parameters = Table(data, Parameters);
+			header.Enums = Table(data, Enums);
+			header.Enumerators = Table(data, Enumerators);
+			header.ClassNames = NameTable(Classes, data);
+			header.EnumNames = NameTable(Enums, data);
+			data.resize((data.size() + 7) & ~size_t(7), '\0');
+			header.Strings = (uint32_t)data.size();
+			header.StringsSize = (uint32_t)Strings.size();
+			data += Strings;
+			if (data.size() > std::numeric_limits<uint32_t>::max())
+				throw std::exception{ "Binary database would be larger than 4GB" };
+			header.Size = (uint32_t)data.size();
+			std::memcpy(data.data(), &header, sizeof(header));
+			return data;
+		}
+	};
+}
+
+void CreateBinaryDBArtifact(path const& path, Options const& options)
+{
+	BinaryDatabaseBuilder builder;
+	for (auto& mirror : GetMirrors())
+		builder.Add(mirror);
+
+	const bool changed = WriteFileIfChanged(path, builder.Build());
+
+	if (options.Verbose)
+		PrintLine(changed ? "Created {}" : "{} unchanged", path.string());
 }
 
 void CreateReflectorHeaderArtifact(path const& path, const Options& options)
 {
 	FileWriter reflect_file{ path };
 	reflect_file.WriteLine("#pragma once");
+	if (options.StaticReflectionData)
+		reflect_file.WriteLine("#define REFLECTOR_STATIC_DATA 1");
 	reflect_file.WriteLine("#include <ReflectorClasses.h>");
 	reflect_file.WriteLine("#define TOKENPASTE3_IMPL(x, y, z) x ## y ## z");
 	reflect_file.WriteLine("#define TOKENPASTE3(x, y, z) TOKENPASTE3_IMPL(x, y, z)");
@@ -64,40 +370,219 @@ void CreateReflectorHeaderArtifact(path const& path, const Options& options)
 	reflect_file.WriteLine("#define {}(...)", options.EnumeratorPrefix);
 	reflect_file.WriteLine("");
 	reflect_file.WriteLine("#define {}_CALLABLE(ret, name, args, id) static int TOKENPASTE3(ScriptFunction_, name, id)(struct lua_State* thread) {{ return 0; }}", options.MacroPrefix);
-	reflect_file.Close();
+	const bool changed = reflect_file.Close();
 	
 	if (options.Verbose)
-		PrintLine("Created {}", path.string());
+		PrintLine(changed ? "Created {}" : "{} unchanged", path.string());
 }
 
 void CreateIncludeListArtifact(path const& path, Options const& options)
 {
-	std::ofstream includes_file(path, std::ios_base::openmode{ std::ios_base::trunc });
+	std::ostringstream includes_file;
 	for (auto& mirror : GetMirrors())
 	{
 		includes_file << "#include " << mirror.SourceFilePath << "" << std::endl;
 	}
+	const bool changed = WriteFileIfChanged(path, includes_file.str());
 	if (options.Verbose)
-		PrintLine("Created {}", path.string());
+		PrintLine(changed ? "Created {}" : "{} unchanged", path.string());
 }
 
 void CreateTypeListArtifact(path const& path, Options const& options)
 {
-	std::ofstream classes_file(path, std::ios_base::openmode{ std::ios_base::trunc });
+	std::ostringstream classes_file;
 
 	for (auto& mirror : GetMirrors())
 	{
 		for (auto& klass : mirror.Classes)
 		{
 			//if (!klass.Flags.is_set(ClassFlags::Struct))
-			classes_file << "ReflectClass(" << klass.Name << ")" << std::endl;
+			classes_file << "ReflectClass(" << QualifiedName(klass) << ")" << std::endl;
+		}
+		for (auto& henum : mirror.Enums)
+			classes_file << "ReflectEnum(" << QualifiedName(henum) << ")" << std::endl;
+	}
+
+	const bool changed = WriteFileIfChanged(path, classes_file.str());
+	if (options.Verbose)
+		PrintLine(changed ? "Created {}" : "{} unchanged", path.string());
+}
+
+PerfectHashTable BuildPerfectHash(std::vector<string_view> const& names)
+{
+	/// "Hash, displace": every name hashes to a bucket, and each bucket gets a seed for a second hash that
+	/// puts all of its names in free slots. Buckets with one name just point at a free slot directly.
+	const auto count = names.size();
+	PerfectHashTable result;
+	result.Displacements.resize(count, 0);
+	result.Slots.resize(count, 0);
+
+	std::vector<std::vector<uint32_t>> buckets(count);
+	for (uint32_t i = 0; i < count; i++)
+		buckets[Reflector::NameHash(names[i]) % count].push_back(i);
+
+	std::vector<size_t> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+	std::vector<bool> taken(count, false);
+	std::vector<size_t> slots;
+	for (auto bucket_index : order)
+	{
+		auto& bucket = buckets[bucket_index];
+		if (bucket.size() < 2)
+			break;
+
+		for (uint64_t seed = 1; ; seed++)
+		{
+			if (seed > 1'000'000)
+				throw std::exception{ "Could not build a perfect hash of the reflected names" };
+
+			slots.clear();
+			for (auto key : bucket)
+			{
+				const auto slot = Reflector::NameHash(names[key], seed) % count;
+				if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+					break;
+				slots.push_back(slot);
+			}
+			if (slots.size() != bucket.size())
+				continue;
+
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				taken[slots[i]] = true;
+				result.Slots[slots[i]] = bucket[i];
+			}
+			result.Displacements[bucket_index] = (int32_t)seed;
+			break;
+		}
+	}
+
+	size_t free_slot = 0;
+	for (auto bucket_index : order)
+	{
+		if (buckets[bucket_index].size() != 1)
+			continue;
+		while (taken[free_slot])
+			free_slot++;
+		taken[free_slot] = true;
+		result.Slots[free_slot] = buckets[bucket_index][0];
+		result.Displacements[bucket_index] = -(int32_t)free_slot - 1;
+	}
+
+	return result;
+}
+
+PerfectHashTable BuildNameIndex(std::vector<string_view> const& entry_names, std::vector<string_view>* duplicate_names)
+{
+	std::vector<string_view> names;
+	std::vector<uint32_t> name_entries;
+	std::set<string_view> seen;
+	for (size_t i = 0; i < entry_names.size(); i++)
+	{
+		if (entry_names[i].empty())
+			continue;
+		if (seen.insert(entry_names[i]).second)
+		{
+			names.push_back(entry_names[i]);
+			name_entries.push_back((uint32_t)i);
+		}
+		else if (duplicate_names)
+			duplicate_names->push_back(entry_names[i]);
+	}
+
+	auto table = BuildPerfectHash(names);
+	for (auto& slot : table.Slots)
+		slot = name_entries[slot];
+	return table;
+}
+
+void CreateRegistryArtifact(path const& path, Options const& options)
+{
+	FileWriter registry_file{ path };
+	registry_file.WriteLine("#pragma once");
+	registry_file.WriteLine("#include \"Includes.reflect.h\"");
+	registry_file.WriteLine("#include <array>");
+	registry_file.WriteLine("#include <unordered_map>");
+	registry_file.WriteLine("");
+
+	/// Writes the tables for one kind of type, and the functions that look them up
+	auto write_registry = [&](string_view kind, string_view data_type, std::vector<std::pair<std::string, std::string>> const& entries) {
+		std::vector<string_view> names;
+		for (auto& [name, getter] : entries)
+			names.push_back(name);
+		std::vector<string_view> duplicate_names;
+		const auto table = BuildNameIndex(names, &duplicate_names);
+		for (auto& name : duplicate_names)
+			PrintLine("Warning: More than one reflected type named '{}'; only the first one can be found by name", name);
+
+		registry_file.WriteLine("namespace Reflector::Registry");
+		registry_file.WriteLine("{{");
+		{
+			auto indent = registry_file.Indent();
+			registry_file.WriteLine("inline constexpr std::array<::Reflector::{}Getter, {}> {}Getters = {{", kind, entries.size(), kind);
+			for (auto& [name, getter] : entries)
+				registry_file.WriteLine("\t{},", getter);
+			registry_file.WriteLine("}};");
+			registry_file.WriteLine("inline constexpr std::array<const char*, {}> {}Names = {{", entries.size(), kind);
+			for (auto& [name, getter] : entries)
+				registry_file.WriteLine("\t\"{}\",", name);
+			registry_file.WriteLine("}};");
+			registry_file.WriteLine("inline constexpr std::array<int32_t, {}> {}NameDisplacements = {{ {} }};", table.Displacements.size(), kind, fmt::join(table.Displacements, ", "));
+			registry_file.WriteLine("inline constexpr std::array<uint32_t, {}> {}NameSlots = {{ {} }};", table.Slots.size(), kind, fmt::join(table.Slots, ", "));
+		}
+		registry_file.WriteLine("}}");
+		registry_file.WriteLine("");
+
+		registry_file.WriteLine("namespace Reflector");
+		registry_file.WriteLine("{{");
+		{
+			auto indent = registry_file.Indent();
+			registry_file.WriteLine("/// Index into Registry::{}Getters, or InvalidIndex", kind);
+			registry_file.WriteLine("constexpr size_t Find{0}Index(std::string_view name) noexcept {{ return FindInNameTable(name, Registry::{0}NameSlots.size(), Registry::{0}NameDisplacements.data(), Registry::{0}NameSlots.data(), Registry::{0}Names.data()); }}", kind);
+			registry_file.WriteLine("inline {1} const* Find{0}ByName(std::string_view name) {{ const auto index = Find{0}Index(name); return index == InvalidIndex ? nullptr : &Registry::{0}Getters[index](); }}", kind, data_type);
+			registry_file.WriteLine("inline {1} const* Find{0}ByType(std::type_index type) {{", kind, data_type);
+			{
+				auto indent = registry_file.Indent();
+				registry_file.WriteLine("/// Built on first use rather than at startup");
+				registry_file.WriteLine("static const auto by_type = [] {{");
+				registry_file.WriteLine("\tstd::unordered_map<std::type_index, {} const*> result;", data_type);
+				registry_file.WriteLine("\tfor (auto getter : Registry::{}Getters) result.emplace(getter().TypeIndex, &getter());", kind);
+				registry_file.WriteLine("\treturn result;");
+				registry_file.WriteLine("}}();");
+				registry_file.WriteLine("const auto it = by_type.find(type);");
+				registry_file.WriteLine("return it == by_type.end() ? nullptr : it->second;");
+			}
+			registry_file.WriteLine("}}");
+		}
+		registry_file.WriteLine("}}");
+		registry_file.WriteLine("");
+	};
+
+	/// The tables are in namespace Reflector::Registry, so the types are named from the global one; that's also how they're found by name
+	std::vector<std::pair<std::string, std::string>> classes;
+	std::vector<std::pair<std::string, std::string>> enums;
+	for (auto& mirror : GetMirrors())
+	{
+		for (auto& klass : mirror.Classes)
+		{
+			const auto name = QualifiedName(klass);
+			classes.emplace_back(name, fmt::format("&::{}::StaticGetReflectionData", name));
 		}
 		for (auto& henum : mirror.Enums)
-			classes_file << "ReflectEnum(" << henum.Name << ")" << std::endl;
+		{
+			const auto name = QualifiedName(henum);
+			enums.emplace_back(name, fmt::format("+[]() -> ::Reflector::EnumReflectionData const& {{ return StaticGetReflectionData(::{}{{}}); }}", name));
+		}
 	}
 
+	write_registry("Class", "ClassReflectionData", classes);
+	write_registry("Enum", "EnumReflectionData", enums);
+
+	const bool changed = registry_file.Close();
 	if (options.Verbose)
-		PrintLine("Created {}", path.string());
+		PrintLine(changed ? "Created {}" : "{} unchanged", path.string());
 }
 
 std::string BuildCompileTimeLiteral(std::string_view str)
@@ -121,9 +606,14 @@ bool BuildClassEntry(FileWriter& output, const FileMirror& mirror, const Class&
 	/// Forward declare all classes
 	/// ///////////////////////////////////// ///
 
-	if (options.ForwardDeclare)
+	/// Nested classes can only be declared in their class, and some namespaces can't be opened again by name
+	if (options.ForwardDeclare && klass.EnclosingClass.empty() && !klass.InTransparentNamespace)
 	{
-		output.WriteLine("{} {};", (klass.Flags.is_set(ClassFlags::DeclaredStruct) ? "struct" : "class"), klass.Name);
+		const auto keyword = klass.Flags.is_set(ClassFlags::DeclaredStruct) ? "struct" : "class";
+		if (klass.Namespace.empty())
+			output.WriteLine("{} {};", keyword, klass.Name);
+		else
+			output.WriteLine("namespace {} {{ {} {}; }}", klass.Namespace, keyword, klass.Name);
 	}
 
 	/// ///////////////////////////////////// ///
@@ -136,7 +626,7 @@ bool BuildClassEntry(FileWriter& output, const FileMirror& mirror, const Class&
 	for (size_t i = 0; i < klass.Fields.size(); i++)
 	{
 		const auto& field = klass.Fields[i];
-		const auto ptr_str = "&" + klass.Name + "::" + field.Name;
+		const auto ptr_str = fmt::format("&{}::{}", klass.Name, field.Name);
 		output.WriteLine("{}_VISITOR(&{}::StaticGetReflectionData().Fields[{}], {}, ::Reflector::CompileTimeFieldData<{}, {}, {}, ::Reflector::CompileTimeLiteral<{}>, decltype({}), {}>{{}});"
 			, options.MacroPrefix, klass.Name, i, ptr_str, field.Type, klass.Name, field.Flags.bits, BuildCompileTimeLiteral(field.Name), ptr_str, ptr_str);
 	}
@@ -210,79 +700,184 @@ bool BuildClassEntry(FileWriter& output, const FileMirror& mirror, const Class&
 	/// Reflection Data Method
 	/// ///////////////////////////////////// ///
 
-	output.WriteLine("static ::Reflector::ClassReflectionData const& StaticGetReflectionData() {{");
-	output.CurrentIndent++;
-	output.WriteLine("static const ::Reflector::ClassReflectionData _data = {{");
-	output.CurrentIndent++;
-	output.WriteLine(".Name = \"{}\",", klass.Name);
-	output.WriteLine(".ParentClassName = \"{}\",", OnlyType(klass.ParentClass));
+	/// In static data mode the lists are stored in arrays next to the class data, so that all of it can be constexpr
+	const bool static_data = options.StaticReflectionData;
+	const string_view data_name = static_data ? "_storage.Class" : "_data";
+
+	auto write_attributes = [&](Declaration const& decl) {
+		if (decl.Attributes.empty())
+			return;
+		output.WriteLine(".Attributes = {},", EscapeJSON(decl.Attributes));
+	};
 
-	if (!klass.Attributes.empty())
+	struct DataList
 	{
-		output.WriteLine(".Attributes = {},", EscapeJSON(klass.Attributes));
-		if (options.UseJSON)
-			output.WriteLine(".AttributesJSON = ::nlohmann::json::parse({}),", EscapeJSON(klass.Attributes));
-	}
-	if (!klass.Flags.is_set(ClassFlags::NoConstructors))
-		output.WriteLine(".Constructor = +[](const ::Reflector::ClassReflectionData& klass){{ return (void*)new self_type{{klass}}; }},");
+		string_view Member;
+		string_view Type;
+		size_t Count = 0;
+		std::function<void()> WriteEntries;
+	};
+	std::vector<DataList> lists;
 
 	/// Fields
-	output.WriteLine(".Fields = {{");
-	output.CurrentIndent++;
+	lists.push_back({ "Fields", "::Reflector::FieldReflectionData", klass.Fields.size(), [&] {
+		for (auto& field : klass.Fields)
+		{
+			output.WriteLine("::Reflector::FieldReflectionData {{");
+			output.CurrentIndent++;
+			output.WriteLine(".Name = \"{}\",", field.Name);
+			output.WriteLine(".FieldType = \"{}\",", field.Type);
+			if (!field.InitializingExpression.empty())
+				output.WriteLine(".Initializer = {},", EscapeJSON(field.InitializingExpression));
+			write_attributes(field);
+			output.WriteLine(".FieldTypeIndex = typeid({})", field.Type);
+			output.CurrentIndent--;
+			output.WriteLine("}},");
+		}
+	} });
+
+	/// Methods
+	lists.push_back({ "Methods", "::Reflector::MethodReflectionData", klass.Methods.size(), [&] {
+		for (auto& method : klass.Methods)
+		{
+			output.WriteLine("::Reflector::MethodReflectionData {{");
+			output.CurrentIndent++;
+			output.WriteLine(".Name = \"{}\",", method.Name);
+			output.WriteLine(".ReturnType = \"{}\",", method.Type);
+			if (!method.GetParameters().empty())
+				output.WriteLine(".Parameters = {},", EscapeJSON(method.GetParameters()));
+			write_attributes(method);
+			if (!method.UniqueName.empty())
+				output.WriteLine(".UniqueName = \"{}\",", method.UniqueName);
+			if (!method.Body.empty())
+				output.WriteLine(".Body = {},", EscapeJSON(method.Body));
+			output.WriteLine(".ReturnTypeIndex = typeid({}),", method.Type);
+			output.WriteLine(".ParentClass = &{}", data_name);
+			output.CurrentIndent--;
+			output.WriteLine("}},");
+		}
+	} });
+
+	/// Properties
+	if (!klass.Properties.empty())
+	{
+		lists.push_back({ "Properties", "::Reflector::PropertyReflectionData", klass.Properties.size(), [&] {
+			for (auto& [key, property] : klass.Properties)
+			{
+				output.WriteLine("::Reflector::PropertyReflectionData {{");
+				output.CurrentIndent++;
+				output.WriteLine(".Name = \"{}\",", property.Name);
+				output.WriteLine(".Type = \"{}\",", property.Type);
+				if (!property.GetterName.empty())
+					output.WriteLine(".GetterName = \"{}\",", property.GetterName);
+				if (!property.SetterName.empty())
+					output.WriteLine(".SetterName = \"{}\",", property.SetterName);
+				output.CurrentIndent--;
+				output.WriteLine("}},");
+			}
+		} });
+	}
+
+	/// Name indices
+	std::vector<std::pair<string_view, PerfectHashTable>> name_indices;
+	auto add_name_index = [&](string_view member, std::vector<string_view> const& names) {
+		auto table = BuildNameIndex(names);
+		if (!table.Slots.empty())
+			name_indices.emplace_back(member, std::move(table));
+	};
+	std::vector<string_view> names;
 	for (auto& field : klass.Fields)
+		names.push_back(field.Name);
+	add_name_index("FieldIndex", names);
+	names.clear();
+	for (auto& method : klass.Methods)
+		names.push_back(method.Name);
+	add_name_index("MethodIndex", names);
+	names.clear();
+	for (auto& method : klass.Methods)
+		names.push_back(method.UniqueName);
+	add_name_index("MethodUniqueNameIndex", names);
+	names.clear();
+	for (auto& [key, property] : klass.Properties)
+		names.push_back(property.Name);
+	add_name_index("PropertyIndex", names);
+
+	auto write_class_header = [&] {
+		output.WriteLine(".Name = \"{}\",", klass.Name);
+		output.WriteLine(".ParentClassName = \"{}\",", OnlyType(std::string{ klass.ParentClass }));
+		write_attributes(klass);
+		if (!klass.Flags.is_set(ClassFlags::NoConstructors))
+			output.WriteLine(".Constructor = +[](const ::Reflector::ClassReflectionData& klass){{ return (void*)new self_type{{klass}}; }},");
+	};
+
+	output.WriteLine("static ::Reflector::ClassReflectionData const& StaticGetReflectionData() {{");
+	output.CurrentIndent++;
+	if (static_data)
 	{
-		output.WriteLine("::Reflector::FieldReflectionData {{");
+		output.WriteLine("struct _storage_t {{");
 		output.CurrentIndent++;
-		output.WriteLine(".Name = \"{}\",", field.Name);
-		output.WriteLine(".FieldType = \"{}\",", field.Type);
-		if (!field.InitializingExpression.empty())
-			output.WriteLine(".Initializer = {},", EscapeJSON(field.InitializingExpression));
-		if (!field.Attributes.empty())
+		for (auto& list : lists)
 		{
-			output.WriteLine(".Attributes = {},", EscapeJSON(field.Attributes));
-			if (options.UseJSON)
-				output.WriteLine(".AttributesJSON = ::nlohmann::json::parse({}),", EscapeJSON(field.Attributes));
+			if (list.Count)
+				output.WriteLine("{} {}[{}];", list.Type, list.Member, list.Count);
 		}
-		output.WriteLine(".FieldTypeIndex = typeid({})", field.Type);
+		for (auto& [member, table] : name_indices)
+			output.WriteLine("int32_t {0}Displacements[{1}]; uint32_t {0}Slots[{1}];", member, table.Slots.size());
+		output.WriteLine("::Reflector::ClassReflectionData Class;");
 		output.CurrentIndent--;
-		output.WriteLine("}},");
-	}
-	output.CurrentIndent--;
-	output.WriteLine("}},");
+		output.WriteLine("}};");
 
-	/// Methods
-	output.WriteLine(".Methods = {{");
-	output.CurrentIndent++;
-	for (auto& method : klass.Methods)
+		output.WriteLine("static constexpr _storage_t _storage = {{");
+		output.CurrentIndent++;
+		for (auto& list : lists)
+		{
+			if (!list.Count)
+				continue;
+			output.WriteLine(".{} = {{", list.Member);
+			output.CurrentIndent++;
+			list.WriteEntries();
+			output.CurrentIndent--;
+			output.WriteLine("}},");
+		}
+		for (auto& [member, table] : name_indices)
+			output.WriteLine(".{0}Displacements = {{ {1} }}, .{0}Slots = {{ {2} }},", member, fmt::join(table.Displacements, ", "), fmt::join(table.Slots, ", "));
+
+		output.WriteLine(".Class = {{");
+		output.CurrentIndent++;
+		write_class_header();
+		for (auto& list : lists)
+		{
+			if (list.Count)
+				output.WriteLine(".{0} = _storage.{0},", list.Member);
+		}
+		for (auto& [member, table] : name_indices)
+			output.WriteLine(".{0} = {{ .Displacements = _storage.{0}Displacements, .Slots = _storage.{0}Slots }},", member);
+		output.WriteLine(".TypeIndex = typeid(self_type)");
+		output.CurrentIndent--;
+		output.WriteLine("}}");
+		output.CurrentIndent--;
+		output.WriteLine("}}; return _storage.Class;");
+	}
+	else
 	{
-		output.WriteLine("::Reflector::MethodReflectionData {{");
+		output.WriteLine("static const ::Reflector::ClassReflectionData _data = {{");
 		output.CurrentIndent++;
-		output.WriteLine(".Name = \"{}\",", method.Name);
-		output.WriteLine(".ReturnType = \"{}\",", method.Type);
-		if (!method.GetParameters().empty())
-			output.WriteLine(".Parameters = {},", EscapeJSON(method.GetParameters()));
-		if (!method.Attributes.empty())
-		{
-			output.WriteLine(".Attributes = {},", EscapeJSON(method.Attributes));
-			if (options.UseJSON)
-				output.WriteLine(".AttributesJSON = ::nlohmann::json::parse({}),", EscapeJSON(method.Attributes));
-		}
-		if (!method.UniqueName.empty())
-			output.WriteLine(".UniqueName = \"{}\",", method.UniqueName);
-		if (!method.Body.empty())
-			output.WriteLine(".Body = {},", EscapeJSON(method.Body));
-		output.WriteLine(".ReturnTypeIndex = typeid({}),", method.Type);
-		output.WriteLine(".ParentClass = &_data");
+		write_class_header();
+		for (auto& list : lists)
+		{
+			output.WriteLine(".{} = {{", list.Member);
+			output.CurrentIndent++;
+			list.WriteEntries();
+			output.CurrentIndent--;
+			output.WriteLine("}},");
+		}
+		for (auto& [member, table] : name_indices)
+			output.WriteLine(".{} = {{ .Displacements = {{ {} }}, .Slots = {{ {} }} }},", member, fmt::join(table.Displacements, ", "), fmt::join(table.Slots, ", "));
+		output.WriteLine(".TypeIndex = typeid(self_type)");
 		output.CurrentIndent--;
-		output.WriteLine("}},");
+		output.WriteLine("}}; return _data;");
 	}
 	output.CurrentIndent--;
-	output.WriteLine("}},");
-
-	output.WriteLine(".TypeIndex = typeid(self_type)");
-	output.CurrentIndent--;
-	output.WriteLine("}}; return _data;");
-	output.CurrentIndent--;
 	output.WriteLine("}}");
 
 	if (!klass.ParentClass.empty())
@@ -307,6 +902,88 @@ bool BuildClassEntry(FileWriter& output, const FileMirror& mirror, const Class&
 	output.WriteLine("\t{}_VISIT_{}_PROPERTIES(visitor);", options.MacroPrefix, klass.Name);
 	output.WriteLine("}}");
 
+	/// ///////////////////////////////////// ///
+	/// Serialization
+	/// ///////////////////////////////////// ///
+
+	if (options.CreateSerializers)
+	{
+		/// Fields that hold addresses are left out by SerializeField and co., which see their actual types
+		std::vector<Field const*> saved_fields;
+		for (auto& field : klass.Fields)
+		{
+			if (!field.Flags.is_set(Reflector::FieldFlags::NoSave))
+				saved_fields.push_back(&field);
+		}
+
+		/// The schema covers the fields in the order they're written, so any change to the binary layout changes the hash
+		std::string schema;
+		for (auto field : saved_fields)
+			schema += fmt::format("{} {};", field->Type, field->Name);
+		output.WriteLine("static constexpr uint64_t StaticSchemaHash() {{ return ::Reflector::CombineSchemaHash({:#x}ULL, ::Reflector::SchemaHashOf<parent_type>()); }}", ContentHash(schema));
+
+		output.WriteLine("template <typename WRITER> void Serialize(WRITER& writer) const {{");
+		output.CurrentIndent++;
+		output.WriteLine("::Reflector::SerializeBase<parent_type>(*this, writer);");
+		for (auto field : saved_fields)
+			output.WriteLine("::Reflector::SerializeField({}, writer);", field->Name);
+		output.CurrentIndent--;
+		output.WriteLine("}}");
+
+		output.WriteLine("template <typename READER> void Deserialize(READER& reader) {{");
+		output.CurrentIndent++;
+		output.WriteLine("::Reflector::DeserializeBase<parent_type>(*this, reader);");
+		for (auto field : saved_fields)
+		{
+			/// Still in the data, so it has to be read past
+			if (field->Flags.is_set(Reflector::FieldFlags::NoLoad))
+				output.WriteLine("::Reflector::SkipField<decltype({})>(reader);", field->Name);
+			else
+				output.WriteLine("::Reflector::DeserializeField({}, reader);", field->Name);
+		}
+		output.CurrentIndent--;
+		output.WriteLine("}}");
+
+		/// So that objects of this class can be read past (e.g. in NoLoad fields) without making one
+		output.WriteLine("template <typename READER> static void StaticSkipSerialized(READER& reader) {{");
+		output.CurrentIndent++;
+		output.WriteLine("::Reflector::SkipBase<parent_type>(reader);");
+		for (auto field : saved_fields)
+			output.WriteLine("::Reflector::SkipField<decltype({})>(reader);", field->Name);
+		output.CurrentIndent--;
+		output.WriteLine("}}");
+	}
+
+	/// ///////////////////////////////////// ///
+	/// JSON
+	/// ///////////////////////////////////// ///
+
+	if (options.UseJSON)
+	{
+		/// Templates so that classes with fields that aren't convertible to JSON still compile, as long as these aren't used
+		output.WriteLine("template <typename JSON> friend void to_json(JSON& j, self_type const& obj) {{");
+		output.CurrentIndent++;
+		output.WriteLine("::Reflector::ParentToJSON<parent_type>(j, obj);");
+		for (auto& field : klass.Fields)
+		{
+			if (!field.Flags.is_set(Reflector::FieldFlags::NoSave))
+				output.WriteLine("::Reflector::FieldToJSON(j, \"{0}\", obj.{0});", field.Name);
+		}
+		output.CurrentIndent--;
+		output.WriteLine("}}");
+
+		output.WriteLine("template <typename JSON> friend void from_json(JSON const& j, self_type& obj) {{");
+		output.CurrentIndent++;
+		output.WriteLine("::Reflector::ParentFromJSON<parent_type>(j, obj);");
+		for (auto& field : klass.Fields)
+		{
+			if (!field.Flags.is_set(Reflector::FieldFlags::NoLoad))
+				output.WriteLine("::Reflector::FieldFromJSON(j, \"{0}\", obj.{0});", field.Name);
+		}
+		output.CurrentIndent--;
+		output.WriteLine("}}");
+	}
+
 	/// ///////////////////////////////////// ///
 	/// All methods
 	/// ///////////////////////////////////// ///
@@ -393,64 +1070,197 @@ bool BuildEnumEntry(FileWriter& output, const FileMirror& mirror, const Enum& he
 	output.WriteLine("enum class {};", henum.Name); /// forward decl;
 
 
+	const bool static_data = options.StaticReflectionData;
+
+	auto write_enumerators = [&] {
+		for (auto& enumerator : henum.Enumerators)
+		{
+			output.WriteLine("::Reflector::EnumeratorReflectionData {{");
+			output.CurrentIndent++;
+			output.WriteLine(".Name = \"{}\",", enumerator.Name);
+			output.WriteLine(".Value = {}", enumerator.Value);
+			output.CurrentIndent--;
+			output.WriteLine("}},");
+		}
+	};
+
 	output.WriteLine("inline ::Reflector::EnumReflectionData const& StaticGetReflectionData({}) {{", henum.Name);
 	output.CurrentIndent++;
-	output.WriteLine("static const ::Reflector::EnumReflectionData _data = {{");
-	output.CurrentIndent++;
+	if (static_data)
+	{
+		if (henum.Enumerators.size())
+			output.WriteLine("struct _storage_t {{ ::Reflector::EnumeratorReflectionData Enumerators[{}]; ::Reflector::EnumReflectionData Enum; }};", henum.Enumerators.size());
+		else
+			output.WriteLine("struct _storage_t {{ ::Reflector::EnumReflectionData Enum; }};");
+		output.WriteLine("static constexpr _storage_t _storage = {{");
+		output.CurrentIndent++;
+		if (henum.Enumerators.size())
+		{
+			output.WriteLine(".Enumerators = {{");
+			output.CurrentIndent++;
+			write_enumerators();
+			output.CurrentIndent--;
+			output.WriteLine("}},");
+		}
+		output.WriteLine(".Enum = {{");
+		output.CurrentIndent++;
+	}
+	else
+	{
+		output.WriteLine("static const ::Reflector::EnumReflectionData _data = {{");
+		output.CurrentIndent++;
+	}
 
 	output.WriteLine(".Name = \"{}\",", henum.Name);
 	if (!henum.Attributes.empty())
-	{
 		output.WriteLine(".Attributes = {},", EscapeJSON(henum.Attributes));
-		if (options.UseJSON)
-			output.WriteLine(".AttributesJSON = ::nlohmann::json::parse({}),", EscapeJSON(henum.Attributes));
+	if (static_data)
+	{
+		if (henum.Enumerators.size())
+			output.WriteLine(".Enumerators = _storage.Enumerators,");
 	}
-	output.WriteLine(".Enumerators = {{");
-	output.CurrentIndent++;
-	for (auto& enumerator : henum.Enumerators)
+	else
 	{
-		output.WriteLine("::Reflector::EnumeratorReflectionData {{");
+		output.WriteLine(".Enumerators = {{");
 		output.CurrentIndent++;
-		output.WriteLine(".Name = \"{}\",", enumerator.Name);
-		output.WriteLine(".Value = {}", enumerator.Value);
+		write_enumerators();
 		output.CurrentIndent--;
 		output.WriteLine("}},");
 	}
-	output.CurrentIndent--;
-	output.WriteLine("}},");
 	output.WriteLine(".TypeIndex = typeid({})", henum.Name);
 	output.CurrentIndent--;
-	output.WriteLine("}}; return _data;");
+	if (static_data)
+	{
+		output.WriteLine("}}");
+		output.CurrentIndent--;
+		output.WriteLine("}}; return _storage.Enum;");
+	}
+	else
+		output.WriteLine("}}; return _data;");
 	output.CurrentIndent--;
 	output.WriteLine("}}");
 
 	output.WriteLine("inline constexpr const char* GetEnumName({0}) {{ return \"{0}\"; }}", henum.Name);
-	output.WriteLine("inline constexpr const char* GetEnumeratorName({} v) {{", henum.Name);
-	{
-		auto indent = output.Indent();
 
-		if (henum.Enumerators.size())
+	/// Enumerators by value; if several share a value, the first one names it
+	std::map<int64_t, std::string_view> names_by_value;
+	for (auto& enumerator : henum.Enumerators)
+		names_by_value.emplace(enumerator.Value, enumerator.Name);
+	const int64_t min_value = names_by_value.empty() ? 0 : names_by_value.begin()->first;
+	const int64_t max_value = names_by_value.empty() ? 0 : names_by_value.rbegin()->first;
+
+	output.WriteLine("inline constexpr size_t GetEnumeratorCount({}) {{ return {}; }}", henum.Name, henum.Enumerators.size());
+	output.WriteLine("inline constexpr int64_t GetMinEnumeratorValue({}) {{ return {}; }}", henum.Name, min_value);
+	output.WriteLine("inline constexpr int64_t GetMaxEnumeratorValue({}) {{ return {}; }}", henum.Name, max_value);
+
+	/// Values that are (nearly) contiguous index a table directly; sparse ones are binary searched.
+	/// The distance between the extremes can be the whole uint64_t range, so the table size is only counted once it's known to be small.
+	const uint64_t value_distance = uint64_t(max_value) - uint64_t(min_value);
+	if (names_by_value.empty())
+	{
+		output.WriteLine("inline constexpr const char* GetEnumeratorName({} v) {{ return \"<Unknown>\"; }}", henum.Name);
+	}
+	else if (value_distance < names_by_value.size() * 2)
+	{
+		const uint64_t value_range = value_distance + 1;
+		std::vector<std::string> table;
+		for (uint64_t i = 0; i < value_range; i++)
 		{
-			output.WriteLine("switch (int64_t(v)) {{");
-			for (auto& enumerator : henum.Enumerators)
-			{
-				output.WriteLine("case {}: return \"{}\";", enumerator.Value, enumerator.Name);
-			}
-			output.WriteLine("}}");
+			auto it = names_by_value.find(int64_t(uint64_t(min_value) + i));
+			table.push_back(it != names_by_value.end() ? fmt::format("\"{}\"", it->second) : "nullptr");
 		}
-		output.WriteLine("return \"<Unknown>\";");	
+		output.WriteLine("inline constexpr const char* {}_EnumeratorNames[] = {{ {} }};", henum.Name, fmt::join(table, ", "));
+		output.WriteLine("inline constexpr const char* GetEnumeratorName({} v) {{", henum.Name);
+		{
+			auto indent = output.Indent();
+			output.WriteLine("const auto index = uint64_t(v) - {}ULL;", uint64_t(min_value));
+			output.WriteLine("return index < {0} && {1}_EnumeratorNames[index] ? {1}_EnumeratorNames[index] : \"<Unknown>\";", value_range, henum.Name);
+		}
+		output.WriteLine("}}");
 	}
-	output.WriteLine("}}");
-	output.WriteLine("inline constexpr {0} GetEnumeratorFromName({0} v, std::string_view name) {{", henum.Name);
+	else
+	{
+		std::vector<std::string> values;
+		std::vector<std::string> names;
+		for (auto& [value, name] : names_by_value)
+		{
+			values.push_back(fmt::format("{}", value));
+			names.push_back(fmt::format("\"{}\"", name));
+		}
+		output.WriteLine("inline constexpr int64_t {}_EnumeratorValues[] = {{ {} }};", henum.Name, fmt::join(values, ", "));
+		output.WriteLine("inline constexpr const char* {}_EnumeratorNames[] = {{ {} }};", henum.Name, fmt::join(names, ", "));
+		output.WriteLine("inline constexpr const char* GetEnumeratorName({} v) {{", henum.Name);
+		{
+			auto indent = output.Indent();
+			output.WriteLine("const auto index = ::Reflector::FindSortedValue({}_EnumeratorValues, int64_t(v));", henum.Name);
+			output.WriteLine("return index != ::Reflector::InvalidIndex ? {}_EnumeratorNames[index] : \"<Unknown>\";", henum.Name);
+		}
+		output.WriteLine("}}");
+	}
+	output.WriteLine("inline constexpr std::optional<{0}> TryGetEnumeratorFromName({0} v, std::string_view name) {{", henum.Name);
 	{
 		auto indent = output.Indent();
+
+		/// Switch on the length of the name, then on the character that best tells apart the names of that length,
+		/// so that at most a few full string compares are made
+		std::map<size_t, std::vector<Enumerator const*>> by_length;
 		for (auto& enumerator : henum.Enumerators)
+			by_length[enumerator.Name.size()].push_back(&enumerator);
+
+		auto write_compare = [&](Enumerator const* enumerator) {
+			output.WriteLine("if (name == \"{}\") return ({}){};", enumerator->Name, henum.Name, enumerator->Value);
+		};
+
+		if (!by_length.empty())
 		{
-			output.WriteLine("if (name == \"{}\") return ({}){};", enumerator.Name, henum.Name, enumerator.Value);
+			output.WriteLine("switch (name.size()) {{");
+			for (auto& [length, enumerators] : by_length)
+			{
+				output.WriteLine("case {}:", length);
+				auto case_indent = output.Indent();
+				if (enumerators.size() == 1)
+				{
+					write_compare(enumerators[0]);
+					output.WriteLine("break;");
+					continue;
+				}
+
+				size_t best_position = 0;
+				size_t best_distinct = 0;
+				for (size_t position = 0; position < length; position++)
+				{
+					std::set<char> distinct;
+					for (auto enumerator : enumerators)
+						distinct.insert(enumerator->Name[position]);
+					if (distinct.size() > best_distinct)
+					{
+						best_position = position;
+						best_distinct = distinct.size();
+					}
+				}
+
+				std::map<char, std::vector<Enumerator const*>> by_char;
+				for (auto enumerator : enumerators)
+					by_char[enumerator->Name[best_position]].push_back(enumerator);
+
+				output.WriteLine("switch (name[{}]) {{", best_position);
+				for (auto& [c, char_enumerators] : by_char)
+				{
+					output.WriteLine("case '{}':", c);
+					auto char_indent = output.Indent();
+					for (auto enumerator : char_enumerators)
+						write_compare(enumerator);
+					output.WriteLine("break;");
+				}
+				output.WriteLine("}}");
+				output.WriteLine("break;");
+			}
+			output.WriteLine("}}");
 		}
-		output.WriteLine("return {{}};");
+		output.WriteLine("return std::nullopt;");
 	}
 	output.WriteLine("}}");
+	output.WriteLine("inline constexpr {0} GetEnumeratorFromName({0} v, std::string_view name) {{ return TryGetEnumeratorFromName(v, name).value_or({0}{{}}); }}", henum.Name);
 	output.WriteLine("inline std::ostream& operator<<(std::ostream& strm, {} v) {{ strm << GetEnumeratorName(v); return strm; }}", henum.Name);
 	output.WriteLine("template <typename T>");
 	output.WriteLine("void OutputFlagsFor(std::ostream& strm, {}, T flags, std::string_view separator = \", \") {{ ", henum.Name);
@@ -467,7 +1277,7 @@ bool BuildEnumEntry(FileWriter& output, const FileMirror& mirror, const Enum& he
 	{
 		output.WriteLine("inline void to_json(json& j, {0} const & p) {{ j = std::underlying_type_t<{0}>(p); }}", henum.Name);
 
-		output.WriteLine("inline void from_json(json const& j, {0}& p) {{ if (j.is_string()) p = GetEnumeratorFromName({0}{{}}, j); else p = ({0})(std::underlying_type_t<{0}>)j; }}", henum.Name);
+		output.WriteLine("inline void from_json(json const& j, {0}& p) {{ if (j.is_string()) p = GetEnumeratorFromName({0}{{}}, j.get_ref<std::string const&>()); else p = ({0})(std::underlying_type_t<{0}>)j; }}", henum.Name);
 	}
 
 	output.EndDefine();
@@ -495,22 +1305,20 @@ void FileWriter::WriteJSON(json const& value)
 
 void FileWriter::WriteLine()
 {
-	mOutFile << '\n';
+	mOutFile.push_back('\n');
 }
 
-void FileWriter::Close()
+void FileWriter::WriteIndent()
 {
-	mOutFile.flush();
-	mOutFile.close();
+	/// Deep enough for any generated code; the rare deeper line just takes more than one append
+	static constexpr string_view Tabs = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	for (auto indent = CurrentIndent; indent > 0; indent -= std::min(indent, Tabs.size()))
+		mOutFile.append(Tabs.substr(0, std::min(indent, Tabs.size())));
 }
 
-FileWriter::~FileWriter()
+bool FileWriter::Close()
 {
-	if (mOutFile.is_open())
-	{
-		mOutFile.close();
-		std::filesystem::remove(mPath);
-	}
+	return WriteFileIfChanged(mPath, string_view{ mOutFile.data(), mOutFile.size() });
 }
 
 
@@ -519,17 +1327,14 @@ void BuildMirrorFile(FileMirror const& file, size_t& modified_files, const Optio
 	auto file_path = file.SourceFilePath;
 	file_path.concat(options.MirrorExtension);
 
-	/// TOOD: Check if we actually need to update the file
-	auto file_change_time = FileNeedsUpdating(file_path, file.SourceFilePath, options);
-	if (file_change_time == 0) return;
-
-	modified_files++;
-
-	if (!options.Quiet)
-		PrintLine("Building class file {}", file_path.string());
+	const auto output_key = OutputKey(file, options);
+	if (!FileNeedsUpdating(file_path, file.SourceFilePath, output_key, options))
+	{
+		UpdateCachedMirrorKey(file.SourceFilePath, output_key);
+		return;
+	}
 
 	FileWriter f(file_path);
-	f.WriteLine("{}{}", TIMESTAMP_TEXT, file_change_time);
 	f.WriteLine("/// Source file: {}", file.SourceFilePath);
 	f.WriteLine("#pragma once");
 
@@ -547,5 +1352,11 @@ void BuildMirrorFile(FileMirror const& file, size_t& modified_files, const Optio
 		f.WriteLine();
 	}
 
-	f.Close();
+	if (f.Close())
+	{
+		modified_files++;
+		if (!options.Quiet)
+			PrintLine("Built class file {}", file_path.string());
+	}
+	UpdateCachedMirrorKey(file.SourceFilePath, output_key);
 }
\ No newline at end of file
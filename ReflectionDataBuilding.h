@@ -6,22 +6,43 @@
 #pragma once
 
 #include "Common.h"
-#include <fstream>
+#include <sstream>
 
-#define TIMESTAMP_TEXT "/// TIMESTAMP: "
-
-uint64_t FileNeedsUpdating(const path& target_path, const path& source_path, const Options& opts);
+/// Combines everything the contents of a mirror file depend on into one key
+uint64_t OutputKey(FileMirror const& file, const Options& opts);
+bool FileNeedsUpdating(const path& target_path, const path& source_path, uint64_t output_key, const Options& opts);
 
 void BuildMirrorFile(FileMirror const& file, size_t& modified_files, const Options& opts);
 
 void CreateTypeListArtifact(path const& cwd, Options const& options);
 void CreateIncludeListArtifact(path const& cwd, Options const& options);
 void CreateJSONDBArtifact(path const& cwd, Options const& options);
+/// The JSON database split into one file per source directory, in `shard_directory`, with an index of them;
+/// only the shards whose mirrors changed since the last run are rewritten
+void CreateShardedJSONDBArtifact(path const& index_path, path const& shard_directory, Options const& options);
+/// The same data as the JSON database, in the format read by Include/ReflectorDatabase.h
+void CreateBinaryDBArtifact(path const& cwd, Options const& options);
 void CreateReflectorHeaderArtifact(path const& cwd, const Options& opts);
+void CreateRegistryArtifact(path const& cwd, Options const& options);
+
+/// A minimal perfect hash of a set of names, in the form Reflector::FindInNameTable expects
+struct PerfectHashTable
+{
+	std::vector<int32_t> Displacements;
+	/// Slot -> index of the key in the names given to BuildPerfectHash
+	std::vector<uint32_t> Slots;
+};
+
+/// The names must be unique
+PerfectHashTable BuildPerfectHash(std::vector<string_view> const& names);
+/// Like BuildPerfectHash, but the slots hold indices into `entry_names`; empty names are left out,
+/// and of repeated names only the first entry can be found (the others are added to `duplicate_names`, if given)
+PerfectHashTable BuildNameIndex(std::vector<string_view> const& entry_names, std::vector<string_view>* duplicate_names = nullptr);
 
+/// Generated files are formatted straight into a memory buffer, and only written out (by Close) if they actually changed
 struct FileWriter
 {
-	std::ofstream mOutFile;
+	fmt::memory_buffer mOutFile;
 	path mPath;
 	size_t CurrentIndent = 0;
 	bool InDefine = false;
@@ -35,40 +56,46 @@ struct FileWriter
 
 	Indenter Indent() { return Indenter{ *this }; }
 
-	FileWriter(path path) : mOutFile{ path }, mPath(path) {}
+	FileWriter(path path) : mPath(path) {}
 
 	template <typename... ARGS>
-	void WriteLine(ARGS&& ... args)
+	void WriteLine(fmt::format_string<ARGS...> format, ARGS&& ... args)
 	{
-		mOutFile << std::string(CurrentIndent, '\t');
-		//((mOutFile << std::forward<ARGS>(args)), ...);
-		fmt::print(mOutFile, std::forward<ARGS>(args)...);
+		WriteIndent();
+		fmt::format_to(std::back_inserter(mOutFile), format, std::forward<ARGS>(args)...);
 		if (InDefine)
-			mOutFile << " \\";
-		mOutFile << '\n';
+			mOutFile.append(string_view{ " \\" });
+		mOutFile.push_back('\n');
 	}
 
 	//void WriteJSON(json const& value);
 
 	template <typename... ARGS>
-	void StartDefine(ARGS&& ... args)
+	void StartDefine(fmt::format_string<ARGS...> format, ARGS&& ... args)
 	{
 		InDefine = true;
-		WriteLine(std::forward<ARGS>(args)...);
+		WriteLine(format, std::forward<ARGS>(args)...);
 		CurrentIndent++;
 	}
 
 	template <typename... ARGS>
-	void EndDefine(ARGS&& ... args)
+	void EndDefine(fmt::format_string<ARGS...> format, ARGS&& ... args)
 	{
 		InDefine = false;
-		WriteLine(std::forward<ARGS>(args)...);
+		WriteLine(format, std::forward<ARGS>(args)...);
 		CurrentIndent--;
 	}
 
-	void WriteLine();
+	void EndDefine()
+	{
+		InDefine = false;
+		WriteLine();
+		CurrentIndent--;
+	}
 
-	void Close();
+	void WriteLine();
+	void WriteIndent();
 
-	~FileWriter();
+	/// Returns whether the file on disk was changed
+	bool Close();
 };
@@ -0,0 +1,99 @@
+/// Copyright 2017-2019 Ghassan.pl
+/// Usage of the works is permitted provided that this instrument is retained with
+/// the works, so that any entity that uses the works is notified of this instrument.
+/// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace
+{
+	thread_local ThreadPool const* CurrentPool = nullptr;
+	thread_local size_t CurrentWorker = 0;
+}
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+	if (thread_count == 0)
+		thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+	for (size_t i = 0; i < thread_count; i++)
+		mQueues.push_back(std::make_unique<WorkQueue>());
+	for (size_t i = 0; i < thread_count; i++)
+		mThreads.emplace_back([this, i] { WorkerLoop(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock lock{ mWakeMutex };
+		mStopping = true;
+	}
+	mWakeCondition.notify_all();
+	for (auto& thread : mThreads)
+		thread.join();
+}
+
+void ThreadPool::Push(std::function<void()> task)
+{
+	/// Workers keep their own follow-up work local; everyone else spreads tasks round-robin
+	const auto index = (CurrentPool == this) ? CurrentWorker : (mNextQueue++ % mQueues.size());
+	{
+		auto& queue = *mQueues[index];
+		std::unique_lock lock{ queue.Mutex };
+		queue.Tasks.push_back(std::move(task));
+	}
+	{
+		std::unique_lock lock{ mWakeMutex };
+		mQueuedTasks++;
+	}
+	mWakeCondition.notify_one();
+}
+
+bool ThreadPool::TryPop(size_t worker_index, std::function<void()>& task)
+{
+	/// Own queue first, newest task (most likely to be cache-warm), then steal the oldest task of the others
+	for (size_t i = 0; i < mQueues.size(); i++)
+	{
+		auto& queue = *mQueues[(worker_index + i) % mQueues.size()];
+		std::unique_lock lock{ queue.Mutex };
+		if (queue.Tasks.empty())
+			continue;
+
+		if (i == 0)
+		{
+			task = std::move(queue.Tasks.back());
+			queue.Tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.Tasks.front());
+			queue.Tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::WorkerLoop(size_t worker_index)
+{
+	CurrentPool = this;
+	CurrentWorker = worker_index;
+
+	while (true)
+	{
+		{
+			std::unique_lock lock{ mWakeMutex };
+			mWakeCondition.wait(lock, [this] { return mQueuedTasks > 0 || mStopping; });
+			if (mQueuedTasks == 0)
+				return; /// stopping, and nothing left to run
+			/// Reserve one task; it is guaranteed to be in some queue, though another worker may get to it first
+			mQueuedTasks--;
+		}
+
+		std::function<void()> task;
+		while (!TryPop(worker_index, task))
+			std::this_thread::yield();
+		task();
+	}
+}
@@ -0,0 +1,74 @@
+/// Copyright 2017-2019 Ghassan.pl
+/// Usage of the works is permitted provided that this instrument is retained with
+/// the works, so that any entity that uses the works is notified of this instrument.
+/// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#pragma once
+
+#include <thread>
+#include <future>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+/// A fixed number of worker threads, each with its own task queue.
+/// Tasks submitted from inside a worker go to that worker's queue; idle workers steal from the others.
+class ThreadPool
+{
+public:
+
+	/// A `thread_count` of 0 means one worker per hardware thread
+	explicit ThreadPool(size_t thread_count = 0);
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const&) = delete;
+	ThreadPool& operator=(ThreadPool const&) = delete;
+
+	template <typename FUNC>
+	auto Submit(FUNC&& func) -> std::future<std::invoke_result_t<std::decay_t<FUNC>>>
+	{
+		using result_type = std::invoke_result_t<std::decay_t<FUNC>>;
+		/// packaged_task is move-only, and std::function wants something copyable
+		auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<FUNC>(func));
+		auto result = task->get_future();
+		Push([task = std::move(task)]() { (*task)(); });
+		return result;
+	}
+
+	size_t ThreadCount() const { return mThreads.size(); }
+
+private:
+
+	struct WorkQueue
+	{
+		std::mutex Mutex;
+		std::deque<std::function<void()>> Tasks;
+	};
+
+	void Push(std::function<void()> task);
+	bool TryPop(size_t worker_index, std::function<void()>& task);
+	void WorkerLoop(size_t worker_index);
+
+	std::vector<std::unique_ptr<WorkQueue>> mQueues;
+	std::vector<std::thread> mThreads;
+	std::atomic<size_t> mNextQueue = 0;
+
+	std::mutex mWakeMutex;
+	std::condition_variable mWakeCondition;
+	size_t mQueuedTasks = 0; /// guarded by mWakeMutex
+	bool mStopping = false; /// guarded by mWakeMutex
+};
+
+/// Unlike std::async's, our futures don't block on destruction, so wait for every task before
+/// get()-ing any of them; otherwise an exception would leave tasks running on data that is going away
+template <typename T>
+void WaitForAll(std::vector<std::future<T>> const& futures)
+{
+	for (auto& future : futures)
+		future.wait();
+}
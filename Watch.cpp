@@ -0,0 +1,218 @@
+/// Copyright 2017-2019 Ghassan.pl
+/// Usage of the works is permitted provided that this instrument is retained with
+/// the works, so that any entity that uses the works is notified of this instrument.
+/// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "Watch.h"
+#include <set>
+#include <thread>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+
+namespace
+{
+	/// Saving a file is often several events (and several files), so wait until things are quiet for this long
+	constexpr int SettleTimeMs = 20;
+
+	struct WatchedDirectory
+	{
+		path Directory;
+		/// False if we're only watching the directory for the sake of some files named explicitly in the options
+		bool AllFiles = false;
+	};
+}
+
+void WatchForChanges(Options const& options, ChangeCallback const& on_change)
+{
+	const int fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0)
+		throw std::exception{ "Could not initialize inotify" };
+
+	constexpr uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE;
+
+	std::map<int, WatchedDirectory> watched_directories;
+	std::set<path> single_files;
+	std::set<path> changed_files;
+
+	auto watch_directory = [&](path const& directory, bool all_files) {
+		const int wd = inotify_add_watch(fd, directory.c_str(), watch_mask);
+		if (wd < 0)
+		{
+			PrintLine("Warning: Could not watch directory {}", directory.string());
+			return;
+		}
+		/// Watching the same directory twice gives the same descriptor
+		auto& watched = watched_directories[wd];
+		watched.Directory = directory;
+		watched.AllFiles |= all_files;
+	};
+
+	/// `found_files`, if given, receives the files already there, as they may have appeared before the watch was in place
+	auto watch_tree = [&](path const& directory, std::set<path>* found_files) {
+		watch_directory(directory, true);
+		std::error_code ec;
+		if (options.Recursive)
+		{
+			for (auto it = std::filesystem::recursive_directory_iterator{ directory, std::filesystem::directory_options::skip_permission_denied, ec }; it != std::filesystem::recursive_directory_iterator{}; it.increment(ec))
+			{
+				const bool is_directory = it->is_directory(ec);
+				if (IsExcludedPath(it->path(), is_directory, options))
+				{
+					if (is_directory)
+						it.disable_recursion_pending();
+				}
+				else if (is_directory)
+					watch_directory(it->path(), true);
+				else if (found_files && IsScannableFile(it->path(), options))
+					found_files->insert(it->path());
+			}
+		}
+		else if (found_files)
+		{
+			for (auto it = std::filesystem::directory_iterator{ directory, ec }; it != std::filesystem::directory_iterator{}; it.increment(ec))
+			{
+				if (!it->is_directory(ec) && IsScannableFile(it->path(), options) && !IsExcludedPath(it->path(), false, options))
+					found_files->insert(it->path());
+			}
+		}
+	};
+
+	for (auto& root : options.PathsToScan)
+	{
+		if (std::filesystem::is_directory(root))
+			watch_tree(std::filesystem::canonical(root), nullptr);
+		else
+		{
+			auto file = std::filesystem::absolute(root).lexically_normal();
+			single_files.insert(file);
+			watch_directory(file.parent_path(), false);
+		}
+	}
+
+	alignas(inotify_event) char buffer[64 * 1024];
+	while (true)
+	{
+		pollfd poll_fd{ fd, POLLIN, 0 };
+		const int ready = poll(&poll_fd, 1, changed_files.empty() ? -1 : SettleTimeMs);
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw std::exception{ "Error while waiting for file changes" };
+		}
+
+		if (ready == 0)
+		{
+			const std::vector<path> batch{ changed_files.begin(), changed_files.end() };
+			changed_files.clear();
+			on_change(batch);
+			continue;
+		}
+
+		const auto length = read(fd, buffer, sizeof(buffer));
+		if (length < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			throw std::exception{ "Error while reading file changes" };
+		}
+
+		for (char* ptr = buffer; ptr < buffer + length; )
+		{
+			auto const& event = *(inotify_event const*)ptr;
+			ptr += sizeof(inotify_event) + event.len;
+
+			if (event.mask & IN_Q_OVERFLOW)
+			{
+				/// We lost track of what happened, so look at everything; unchanged files will come out of the build cache
+				PrintLine("Warning: Too many changes at once, rescanning");
+				for (auto& file : FindFilesToScan(options))
+					changed_files.insert(std::filesystem::absolute(file).lexically_normal());
+				continue;
+			}
+
+			if (event.mask & IN_IGNORED)
+			{
+				watched_directories.erase(event.wd);
+				continue;
+			}
+
+			auto watched = watched_directories.find(event.wd);
+			if (watched == watched_directories.end() || event.len == 0)
+				continue;
+
+			auto file = watched->second.Directory / event.name;
+			if (event.mask & IN_ISDIR)
+			{
+				if (watched->second.AllFiles && options.Recursive && (event.mask & (IN_CREATE | IN_MOVED_TO)) && !IsExcludedPath(file, true, options))
+					watch_tree(file, &changed_files);
+				continue;
+			}
+
+			/// A new file will also get IN_CLOSE_WRITE once it's written
+			if (event.mask & IN_CREATE)
+				continue;
+
+			if (!watched->second.AllFiles && !single_files.contains(file))
+				continue;
+			if (!IsScannableFile(file, options) || (watched->second.AllFiles && IsExcludedPath(file, false, options)))
+				continue;
+
+			changed_files.insert(std::move(file));
+		}
+	}
+}
+
+#else
+
+void WatchForChanges(Options const& options, ChangeCallback const& on_change)
+{
+	/// No native change notifications here, so compare modification times every now and then
+	constexpr auto PollInterval = std::chrono::milliseconds(250);
+
+	auto snapshot = [&]() {
+		std::map<path, std::filesystem::file_time_type> result;
+		std::error_code ec;
+		for (auto& file : FindFilesToScan(options))
+		{
+			const auto time = std::filesystem::last_write_time(file, ec);
+			if (!ec)
+				result[std::filesystem::absolute(file).lexically_normal()] = time;
+		}
+		return result;
+	};
+
+	auto previous = snapshot();
+	while (true)
+	{
+		std::this_thread::sleep_for(PollInterval);
+
+		auto current = snapshot();
+		std::vector<path> changed_files;
+		for (auto& [file, time] : current)
+		{
+			auto it = previous.find(file);
+			if (it == previous.end() || it->second != time)
+				changed_files.push_back(file);
+		}
+		for (auto& [file, time] : previous)
+		{
+			if (!current.contains(file))
+				changed_files.push_back(file);
+		}
+
+		if (!changed_files.empty())
+			on_change(changed_files);
+		previous = std::move(current);
+	}
+}
+
+#endif
@@ -0,0 +1,16 @@
+/// Copyright 2017-2019 Ghassan.pl
+/// Usage of the works is permitted provided that this instrument is retained with
+/// the works, so that any entity that uses the works is notified of this instrument.
+/// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#pragma once
+
+#include "Common.h"
+#include <functional>
+
+/// Called with every batch of scannable files that were modified, created or deleted (deleted files no longer exist)
+using ChangeCallback = std::function<void(std::vector<path> const& changed_files)>;
+
+/// Watches `options.PathsToScan` and reports changes to `on_change` as they happen. Never returns.
+/// Uses inotify on Linux; elsewhere it falls back to polling modification times.
+void WatchForChanges(Options const& options, ChangeCallback const& on_change);
@@ -6,143 +6,296 @@
 #include "Common.h"
 #include "Parse.h"
 #include "ReflectionDataBuilding.h"
+#include "ThreadPool.h"
+#include "Cache.h"
+#include "Watch.h"
 //#include <args.hxx>
 #include <sstream>
 #include <vector>
-#include <thread>
 #include <future>
+#include <chrono>
+#include <set>
+#include <mutex>
 #include <sqlite_orm/sqlite_orm.h>
 
-int main(int argc, const char* argv[])
+struct ArtifactPaths
 {
-	/// If executable changed, it's newer than the files it created in the past, so they need to be rebuild
-	ChangeTime = std::filesystem::last_write_time(argv[0]).time_since_epoch().count();
-	
-	/*
-	args::PositionalList<std::filesystem::path> paths_list{ parser, "files", "Files or directories to scan", args::Options::Required };
-	*/
-	if (argc != 2)
+	path Directory;
+	path ReflectorHeader;
+	path ClassList;
+	path IncludeList;
+	path Database;
+	path DatabaseIndex;
+	path DatabaseShards;
+	path BinaryDatabase;
+	path Registry;
+	path BuildCache;
+
+	explicit ArtifactPaths(Options const& options)
+		: Directory(std::filesystem::absolute(options.ArtifactPath.empty() ? std::filesystem::current_path() : path{ options.ArtifactPath }))
+		, ReflectorHeader(Directory / "Reflector.h")
+		, ClassList(Directory / "Classes.reflect.h")
+		, IncludeList(Directory / "Includes.reflect.h")
+		, Database(Directory / "ReflectDatabase.json")
+		, DatabaseIndex(Directory / "ReflectDatabase.index.json")
+		, DatabaseShards(Directory / "ReflectDatabase")
+		, BinaryDatabase(Directory / "ReflectDatabase.bin")
+		, Registry(Directory / "Registry.reflect.h")
+		, BuildCache(Directory / "ReflectCache.bin")
 	{
-		std::cerr << "Syntax: " << std::filesystem::path{ argv[0] }.filename() << " <options file>\n";
-		return 1;
 	}
+};
 
-	try
+/// Parses the files into mirrors; returns false if any of them had errors (which are already reported)
+bool ParseFiles(ThreadPool& pool, std::vector<path> const& files, Options const& options)
+{
+	std::vector<std::future<bool>> parsers;
+	for (auto& file : files)
 	{
-		Options options{ argv[1] };
+		parsers.push_back(pool.Submit([&]() { return ParseClassFile(file, options); }));
+	}
 
-		const auto artifact_path = std::filesystem::absolute(options.ArtifactPath.empty() ? std::filesystem::current_path() : path{ options.ArtifactPath });
-		const auto reflector_h_path = artifact_path / "Reflector.h";
-		const auto classes_h_path = artifact_path / "Classes.reflect.h";
-		const auto includes_h_path = artifact_path / "Includes.reflect.h";
-		const auto reflect_database_path = artifact_path / "ReflectDatabase.json";
+	WaitForAll(parsers);
+	CollectMirrors();
+	return std::all_of(parsers.begin(), parsers.end(), [](auto& future) { return future.get(); });
+}
 
-		std::vector<std::filesystem::path> final_files;
-		for (auto& path : options.PathsToScan)
-		{
-			fmt::print("Looking in '{}'...\n", std::filesystem::absolute(path).string());
-			if (std::filesystem::is_directory(path))
-			{
-				auto add_files = [&](const std::filesystem::path& file) {
-					auto u8file = file.string();
-					auto full = string_view{ u8file };
-					if (full.ends_with(options.MirrorExtension)) return;
-
-					auto ext = file.extension().string();
-					std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-					if (!std::filesystem::is_directory(file) && std::find(options.ExtensionsToScan.begin(), options.ExtensionsToScan.end(), ext) != options.ExtensionsToScan.end())
-					{
-						final_files.push_back(file);
-					}
-				};
-				if (options.Recursive)
-				{
-					for (auto it = std::filesystem::recursive_directory_iterator{ std::filesystem::canonical(path) }; it != std::filesystem::recursive_directory_iterator{}; ++it)
-					{
-						add_files(*it);
-					}
-				}
-				else
-				{
-					for (auto it = std::filesystem::directory_iterator{ std::filesystem::canonical(path) }; it != std::filesystem::directory_iterator{}; ++it)
-					{
-						add_files(*it);
-					}
-				}
-			}
-			else
-				final_files.push_back(std::move(path));
-		}
+/// Finds the files to scan and parses them into mirrors. Every directory is listed in a task of its own, and files are parsed
+/// as soon as they are found, so walking big trees and parsing overlap. Returns false if any of the files had errors (which are already reported).
+bool ParseFilesToScan(ThreadPool& pool, Options const& options, size_t& found_files)
+{
+	std::mutex mutex;
+	std::vector<std::future<bool>> parsers;
+	std::vector<std::future<void>> walkers;
 
-		PrintLine("{} reflectable files found", final_files.size());
+	const std::function<void(path)> parse = [&](path file) {
+		auto parser = pool.Submit([&options, file = std::move(file)]() { return ParseClassFile(file, options); });
+		std::unique_lock lock{ mutex };
+		parsers.push_back(std::move(parser));
+	};
+	std::function<void(path, std::string)> walk;
+	walk = [&](path directory, std::string relative_directory) {
+		auto walker = pool.Submit([&, directory = std::move(directory), relative_directory = std::move(relative_directory)]() {
+			ScanDirectory(directory, relative_directory, options, parse, walk);
+		});
+		std::unique_lock lock{ mutex };
+		walkers.push_back(std::move(walker));
+	};
 
-		std::vector<std::future<bool>> parsers;
-		/// Parse all types
-		for (auto& file : final_files)
+	for (auto& path : options.PathsToScan)
+	{
+		if (std::filesystem::is_directory(path))
+			walk(std::filesystem::canonical(path), {});
+		else
+			parse(path);
+	}
+
+	/// Walkers submit more walkers, so the walk is done only once the last one submitted has finished
+	std::vector<std::future<void>> finished_walkers;
+	while (true)
+	{
+		std::future<void> walker;
 		{
-			parsers.push_back(std::async(ParseClassFile, std::filesystem::path(file), options));
+			std::unique_lock lock{ mutex };
+			if (finished_walkers.size() == walkers.size())
+				break;
+			walker = std::move(walkers[finished_walkers.size()]);
 		}
+		walker.wait();
+		finished_walkers.push_back(std::move(walker));
+	}
 
-		auto success = std::all_of(parsers.begin(), parsers.end(), [](auto& future) { return future.get(); });
-		if (!success)
-			return -1;
+	WaitForAll(parsers);
+	CollectMirrors();
+	for (auto& walker : finished_walkers)
+		walker.get(); /// to propagate exceptions
 
-		/// Create artificial methods, knowing all the reflected classes
-		CreateArtificialMethods();
+	found_files = parsers.size();
+	return std::all_of(parsers.begin(), parsers.end(), [](auto& future) { return future.get(); });
+}
 
-		/// Output artifacts
-		std::atomic<size_t> modified_files = 0;
+/// Creates the mirror files and artifacts for the current set of mirrors, and saves the build cache.
+/// `mirror_set_changed` forces the artifacts to be rebuilt even if no mirror file changed (e.g. when a file was deleted).
+/// Returns the number of mirror files that changed.
+size_t BuildOutputs(ThreadPool& pool, ArtifactPaths const& paths, Options const& options, bool mirror_set_changed)
+{
+	/// Create artificial methods, knowing all the reflected classes
+	CreateArtificialMethods(pool);
 
-		std::vector<std::future<void>> futures;
-		for (auto& file : GetMirrors())
-		{
-			futures.push_back(std::async([&]() {
-				size_t mod = 0;
-				BuildMirrorFile(file, mod, options);
-				modified_files += mod;
-			}));
-		}
-		for (auto& future : futures)
-			future.get(); /// to propagate exceptions
-		futures.clear();
+	/// Output artifacts
+	std::atomic<size_t> modified_files = 0;
+
+	std::vector<std::future<void>> futures;
+	for (auto& file : GetMirrors())
+	{
+		futures.push_back(pool.Submit([&]() {
+			size_t mod = 0;
+			BuildMirrorFile(file, mod, options);
+			modified_files += mod;
+		}));
+	}
+	WaitForAll(futures);
+	for (auto& future : futures)
+		future.get(); /// to propagate exceptions
+	futures.clear();
+
+	std::filesystem::create_directories(paths.Directory);
+	SaveBuildCache(paths.BuildCache, options);
+
+	const bool type_list_missing = !std::filesystem::exists(paths.ClassList) || options.Force;
+	const bool include_list_missing = !std::filesystem::exists(paths.IncludeList) || options.Force;
+	const bool json_db_missing = options.CreateDatabase && (!std::filesystem::exists(options.ShardDatabase ? paths.DatabaseIndex : paths.Database) || options.Force);
+	const bool binary_db_missing = options.CreateBinaryDatabase && (!std::filesystem::exists(paths.BinaryDatabase) || options.Force);
+	const bool registry_missing = options.CreateRegistry && (!std::filesystem::exists(paths.Registry) || options.Force);
+	if (options.CreateArtifacts && (modified_files || mirror_set_changed || type_list_missing || include_list_missing || json_db_missing || binary_db_missing || registry_missing))
+	{
+		futures.push_back(pool.Submit([&]() { CreateTypeListArtifact(paths.ClassList, options); }));
+		futures.push_back(pool.Submit([&]() { CreateIncludeListArtifact(paths.IncludeList, options); }));
+		if (options.CreateDatabase && options.ShardDatabase)
+			futures.push_back(pool.Submit([&]() { CreateShardedJSONDBArtifact(paths.DatabaseIndex, paths.DatabaseShards, options); }));
+		else if (options.CreateDatabase)
+			futures.push_back(pool.Submit([&]() { CreateJSONDBArtifact(paths.Database, options); }));
+		if (options.CreateBinaryDatabase)
+			futures.push_back(pool.Submit([&]() { CreateBinaryDBArtifact(paths.BinaryDatabase, options); }));
+		if (options.CreateRegistry)
+			futures.push_back(pool.Submit([&]() { CreateRegistryArtifact(paths.Registry, options); }));
+	}
+
+	/// Reflector.h depends on the options, so it is always regenerated; it's only written when it changed
+	futures.push_back(pool.Submit([&]() { CreateReflectorHeaderArtifact(paths.ReflectorHeader, options); }));
+
+	WaitForAll(futures);
+	for (auto& future : futures)
+		future.get(); /// to propagate exceptions
+	futures.clear();
+
+	if (!options.Quiet)
+	{
+		if (modified_files)
+			PrintLine("{} mirror files changed", modified_files);
+		else
+			PrintLine("No mirror files changed");
+	}
+
+	return modified_files;
+}
+
+/// Re-parses just the files that changed, and rebuilds whatever depends on them; returns false if any of them had errors
+bool UpdateChangedFiles(ThreadPool& pool, ArtifactPaths const& paths, Options const& options, std::vector<path> const& changed_files)
+{
+	const auto start = std::chrono::steady_clock::now();
 
-		/// Check if 
+	auto mirror_paths = [] {
+		std::vector<path> result;
+		for (auto& mirror : GetMirrors())
+			result.push_back(mirror.SourceFilePath);
+		return result;
+	};
+	const auto previous_mirror_paths = mirror_paths();
 
-		//const auto cwd = std::filesystem::absolute(options.ArtifactPath.empty() ? std::filesystem::current_path() : std::filesystem::path{ options.ArtifactPath });
-		std::filesystem::create_directories(artifact_path);
+	std::vector<path> existing_files;
+	for (auto& file : changed_files)
+	{
+		const auto source_path = std::filesystem::absolute(file.lexically_normal());
+		RemoveMirror(source_path);
 
-		const bool type_list_missing = !std::filesystem::exists(classes_h_path) || options.Force;
-		const bool include_list_missing = !std::filesystem::exists(includes_h_path) || options.Force;
-		const bool json_db_missing = options.CreateDatabase && (!std::filesystem::exists(reflect_database_path) || options.Force);
-		if (options.CreateArtifacts && (modified_files || type_list_missing || include_list_missing || json_db_missing))
+		if (std::filesystem::exists(source_path))
+			existing_files.push_back(source_path);
+		else
 		{
-			futures.push_back(std::async(CreateTypeListArtifact, classes_h_path, options));
-			futures.push_back(std::async(CreateIncludeListArtifact, includes_h_path, options));
-			if (options.CreateDatabase)
-				futures.push_back(std::async(CreateJSONDBArtifact, reflect_database_path, options));
+			if (options.Verbose)
+				PrintLine("{} removed", source_path.string());
+			ForgetCachedFile(source_path);
 		}
+	}
+
+	if (!ParseFiles(pool, existing_files, options))
+	{
+		/// The broken files stay out of the mirrors until they are fixed, so don't build anything off of an incomplete picture
+		PrintLine("Errors found, waiting for further changes");
+		return false;
+	}
+
+	BuildOutputs(pool, paths, options, mirror_paths() != previous_mirror_paths);
+
+	if (!options.Quiet)
+	{
+		const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		PrintLine("Updated {} changed files in {} ms", changed_files.size(), elapsed.count());
+	}
+	return true;
+}
 
-		const bool create_reflector = !std::filesystem::exists(reflector_h_path) || options.Force;
+int main(int argc, const char* argv[])
+{
+	/*
+	args::PositionalList<std::filesystem::path> paths_list{ parser, "files", "Files or directories to scan", args::Options::Required };
+	*/
+	const bool watch = argc == 3 && string_view{ argv[2] } == "--watch";
+	if (argc != 2 && !watch)
+	{
+		std::cerr << "Syntax: " << std::filesystem::path{ argv[0] }.filename() << " <options file> [--watch]\n";
+		return 1;
+	}
 
-		if (create_reflector)
-			futures.push_back(std::async(CreateReflectorHeaderArtifact, reflector_h_path, options));
+	try
+	{
+		/// If executable changed, the files it created in the past may be different now, so they need to be rebuilt
+		std::string executable;
+		if (!ReadWholeFile(argv[0], executable))
+			throw std::exception{ "Could not read the reflector executable" };
+		ToolHash = ContentHash(executable);
 
-		for (auto& future : futures)
-			future.get(); /// to propagate exceptions
-		futures.clear();
+		Options options{ argv[1] };
+		ThreadPool pool{ options.Jobs };
 
 		if (options.Verbose)
-		{
-			if (!create_reflector)
-				PrintLine("{} exists, skipping", reflector_h_path.string());
-		}
+			PrintLine("Using {} worker threads", pool.ThreadCount());
+
+		const ArtifactPaths paths{ options };
+
+		LoadBuildCache(paths.BuildCache, options);
+
+		for (auto& path : options.PathsToScan)
+			fmt::print("Looking in '{}'...\n", std::filesystem::absolute(path).string());
+
+		/// Parse all types
+		size_t found_files = 0;
+		const bool parsed = ParseFilesToScan(pool, options, found_files);
 
-		if (!options.Quiet)
+		PrintLine("{} reflectable files found", found_files);
+
+		if (!parsed)
+			return -1;
+
+		PrintLine("{} files without annotations skipped", GetPrefilteredFileCount());
+
+		BuildOutputs(pool, paths, options, false);
+
+		if (watch)
 		{
-			if (modified_files)
-				PrintLine("{} mirror files changed", modified_files);
-			else
-				PrintLine("No mirror files changed");
+			/// Everything is up to date now; from here on only the changes need looking at
+			options.Force = false;
+
+			/// Files that failed to parse are left out of the mirrors, so they're retried along with every later change until they're fixed
+			std::set<path> files_to_update;
+
+			PrintLine("Watching for changes...");
+			std::cout.flush();
+			WatchForChanges(options, [&](std::vector<path> const& changed_files) {
+				files_to_update.insert(changed_files.begin(), changed_files.end());
+				try
+				{
+					if (UpdateChangedFiles(pool, paths, options, { files_to_update.begin(), files_to_update.end() }))
+						files_to_update.clear();
+				}
+				catch (std::exception& e)
+				{
+					std::cerr << e.what() << "\n";
+					files_to_update.clear();
+				}
+				std::cout.flush();
+			});
 		}
 	}
 	catch (json::parse_error e)